@@ -1,23 +1,69 @@
 #pragma once
 
+#include "check_policy.hpp"
 #include "imports.hpp"
 
 #include <batteries/checked_cast.hpp>
 
+#include <atomic>
+#include <type_traits>
 #include <vector>
 
 namespace tiny_pointers {
 
+/** \brief Returns a mask of the lowest `bits` bits (0 <= `bits` <= 64).
+ */
+inline u64 low_bits_mask(usize bits) noexcept
+{
+    return (bits >= 64) ? ~u64{0} : ((u64{1} << bits) - 1);
+}
+
+/** \brief Plain loads and stores of the words bit_copy reads and writes.
+ */
+struct PlainWordAccess {
+    static u64 load(const u64* p) noexcept
+    {
+        return *p;
+    }
+
+    static void store(u64* p, u64 value) noexcept
+    {
+        *p = value;
+    }
+};
+
+/** \brief Relaxed atomic loads and stores (via std::atomic_ref) of the words
+ * bit_copy reads and writes, for bit vectors that one thread writes while
+ * others read (see SeqLockDereferenceTable).  On the usual 64-bit targets
+ * these compile to the same instructions as PlainWordAccess.
+ */
+struct RelaxedWordAccess {
+    static u64 load(const u64* p) noexcept
+    {
+        return std::atomic_ref<u64>{*const_cast<u64*>(p)}.load(
+            std::memory_order_relaxed);
+    }
+
+    static void store(u64* p, u64 value) noexcept
+    {
+        std::atomic_ref<u64>{*p}.store(value, std::memory_order_relaxed);
+    }
+};
+
+template <typename SrcAccess = PlainWordAccess,
+          typename DstAccess = PlainWordAccess>
 inline void bit_copy(const u64* p_src, usize src_shift,  //
                      u64* p_dst, usize dst_shift,        //
                      usize n_to_copy)
 {
     while (n_to_copy) {
         const usize bits = std::min(n_to_copy, 64 - std::max(src_shift, dst_shift));
-        const u64 mask = (u64{1} << bits) - 1;
+        const u64 mask = low_bits_mask(bits);
 
-        *p_dst &= ~(mask << dst_shift);
-        *p_dst |= ((*p_src >> src_shift) & mask) << dst_shift;
+        u64 dst_word = DstAccess::load(p_dst);
+        dst_word &= ~(mask << dst_shift);
+        dst_word |= ((SrcAccess::load(p_src) >> src_shift) & mask) << dst_shift;
+        DstAccess::store(p_dst, dst_word);
 
         src_shift += bits;
         dst_shift += bits;
@@ -39,6 +85,18 @@ class BitVec
    public:
     using Self = BitVec;
 
+    // BitVec is shared by all tables, so its checks follow the build-wide
+    // policy rather than a template parameter.
+    //
+    using CheckPolicy = DefaultCheckPolicy;
+
+    // The per-bit and per-range bounds checks sit under every slot and
+    // free-list access, so they only run in debug builds (and never under
+    // NoChecks).
+    //
+    using BoundsCheckPolicy =
+        std::conditional_t<CheckPolicy::kEnabled, DebugChecks, NoChecks>;
+
     BitVec() = default;
 
     explicit BitVec(usize n) noexcept : bit_size_{n}, words_((n + 63) / 64, 0)
@@ -51,9 +109,9 @@ class BitVec
 
     BitVec(usize n, u64 data) noexcept : bit_size_{n}, words_((n + 63) / 64)
     {
-        BATT_CHECK_LE(n, 64);
+        TINY_POINTERS_CHECK_LE(CheckPolicy, n, 64u);
         if (n) {
-            this->words_[0] = data & ((u64{1} << n) - 1);
+            this->words_[0] = data & low_bits_mask(n);
         }
     }
     BitVec(i32 n, u64 data) noexcept : BitVec{BATT_CHECKED_CAST(usize, n), data}
@@ -84,6 +142,8 @@ class BitVec
 
     bool operator[](usize i) const noexcept
     {
+        TINY_POINTERS_CHECK_LT(BoundsCheckPolicy, i, this->bit_size_);
+
         return (this->words_[i / 64] & (u64{1} << (i % 64))) != 0;
     }
 
@@ -94,6 +154,8 @@ class BitVec
 
     Self& set(usize i, bool b = true) noexcept
     {
+        TINY_POINTERS_CHECK_LT(BoundsCheckPolicy, i, this->bit_size_);
+
         if (b) {
             this->words_[i / 64] |= u64{1} << (i % 64);
         } else {
@@ -104,6 +166,9 @@ class BitVec
 
     BitVec get_range(usize begin, usize end) const noexcept
     {
+        TINY_POINTERS_CHECK_LE(BoundsCheckPolicy, begin, end);
+        TINY_POINTERS_CHECK_LE(BoundsCheckPolicy, end, this->bit_size_);
+
         const usize n_to_copy = end - begin;
 
         BitVec dst(n_to_copy);
@@ -117,6 +182,8 @@ class BitVec
 
     Self& set_range(usize begin, const BitVec& src) noexcept
     {
+        TINY_POINTERS_CHECK_LE(BoundsCheckPolicy, begin + src.size(), this->bit_size_);
+
         bit_copy(src.words_.data(), 0,                          //
                  this->words_.data() + begin / 64, begin % 64,  //
                  src.size());
@@ -124,9 +191,64 @@ class BitVec
         return *this;
     }
 
+    /** \brief Copies the range [begin, begin + `dst`.size()) into `dst`,
+     * loading the words of this with relaxed atomic loads; `dst` keeps its
+     * storage, so repeated loads (e.g. seqlock retries) don't allocate.
+     */
+    void load_range_relaxed(usize begin, BitVec& dst) const noexcept
+    {
+        TINY_POINTERS_CHECK_LE(BoundsCheckPolicy, begin + dst.size(), this->bit_size_);
+
+        bit_copy<RelaxedWordAccess, PlainWordAccess>(
+            this->words_.data() + begin / 64, begin % 64,  //
+            dst.words_.data(), 0,                          //
+            dst.size());
+    }
+
+    /** \brief Like set_range, but stores to the words of this with relaxed
+     * atomic stores, so that load_range_relaxed may run concurrently.
+     */
+    Self& set_range_relaxed(usize begin, const BitVec& src) noexcept
+    {
+        TINY_POINTERS_CHECK_LE(BoundsCheckPolicy, begin + src.size(), this->bit_size_);
+
+        bit_copy<PlainWordAccess, RelaxedWordAccess>(
+            src.words_.data(), 0,                          //
+            this->words_.data() + begin / 64, begin % 64,  //
+            src.size());
+
+        return *this;
+    }
+
+    /** \brief Returns the number of 1 bits in the range [begin, end).
+     */
+    usize count(usize begin, usize end) const noexcept
+    {
+        usize total = 0;
+        this->for_each_word(begin, end, [&total](usize, u64 word) {
+            total += __builtin_popcountll(word);
+        });
+        return total;
+    }
+
+    /** \brief Invokes `fn(i)` for each 1 bit in the range [begin, end), in
+     * increasing order of position `i`; visits one word (64 bits) at a time,
+     * so runs of 0 bits are skipped cheaply.
+     */
+    template <typename Fn>
+    void for_each_set_bit(usize begin, usize end, Fn&& fn) const
+    {
+        this->for_each_word(begin, end, [&fn](usize base, u64 word) {
+            while (word) {
+                fn(base + __builtin_ctzll(word));
+                word &= word - 1;
+            }
+        });
+    }
+
     u64 int_value() const noexcept
     {
-        return this->words_[0] & ((u64{1} << this->size()) - 1);
+        return this->words_[0] & low_bits_mask(this->size());
     }
 
     std::string_view as_str() const noexcept
@@ -134,7 +256,59 @@ class BitVec
         return std::string_view{(const char*)this->words_.data(), this->bit_size_ / 8};
     }
 
+    /** \brief The number of 64-bit words backing this; bit `i` is bit `i % 64`
+     * of word `i / 64`.
+     */
+    usize word_count() const noexcept
+    {
+        return this->words_.size();
+    }
+
+    /** \brief The number of bytes of memory backing this.
+     */
+    usize byte_size() const noexcept
+    {
+        return this->words_.size() * sizeof(u64);
+    }
+
+    const u64* data() const noexcept
+    {
+        return this->words_.data();
+    }
+
+    u64* data() noexcept
+    {
+        return this->words_.data();
+    }
+
    private:
+    /** \brief Invokes `fn(base, word)` for each word overlapping [begin, end),
+     * with bits outside the range masked off; `base` is the position of bit 0
+     * of `word`.
+     */
+    template <typename Fn>
+    void for_each_word(usize begin, usize end, Fn&& fn) const
+    {
+        if (begin >= end) {
+            return;
+        }
+        const usize first_word = begin / 64;
+        const usize last_word = (end - 1) / 64;
+
+        for (usize word_i = first_word; word_i <= last_word; ++word_i) {
+            u64 word = this->words_[word_i];
+            if (word_i == first_word) {
+                word &= ~low_bits_mask(begin % 64);
+            }
+            if (word_i == last_word) {
+                word &= low_bits_mask(end - word_i * 64);
+            }
+            fn(word_i * 64, word);
+        }
+    }
+
+    //+++++++++++-+-+--+----- --- -- -  -  -   -
+
     usize bit_size_ = 0;
     SmallVec<u64, 1> words_;
 };
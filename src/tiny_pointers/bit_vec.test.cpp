@@ -6,6 +6,7 @@
 #include <gtest/gtest.h>
 
 #include <bitset>
+#include <vector>
 
 namespace {
 
@@ -65,6 +66,49 @@ TEST(BitVecTest, Test)
     for (usize i = 0; i < 128; ++i) {
         EXPECT_EQ(z.get_range(i * 7, (i + 1) * 7).int_value(), 127 - i);
     }
+
+    // Whole 64-bit words, aligned and unaligned.
+    //
+    BitVec w(64 * 5);
+    for (usize offset : {0, 64, 3, 100}) {
+        const u64 data = 0xfedcba9876543210ull ^ offset;
+        w.set_range(offset, BitVec{64, data});
+
+        EXPECT_EQ(BitVec(64, data).int_value(), data);
+        EXPECT_EQ(w.get_range(offset, offset + 64).int_value(), data);
+    }
+}
+
+TEST(BitVecTest, CountAndForEachSetBit)
+{
+    BitVec x(300);
+
+    std::vector<usize> expected;
+    for (usize i = 0; i < x.size(); i += 7) {
+        x.set(i);
+        expected.push_back(i);
+    }
+
+    for (usize begin : {0, 1, 63, 64, 70}) {
+        for (usize end : {begin, begin + 1, (usize)128, (usize)299, (usize)300}) {
+            if (end < begin) {
+                continue;
+            }
+            std::vector<usize> actual;
+            x.for_each_set_bit(begin, end, [&actual](usize i) {
+                actual.push_back(i);
+            });
+
+            std::vector<usize> want;
+            for (usize i : expected) {
+                if (i >= begin && i < end) {
+                    want.push_back(i);
+                }
+            }
+            EXPECT_EQ(actual, want) << BATT_INSPECT(begin) << BATT_INSPECT(end);
+            EXPECT_EQ(x.count(begin, end), want.size());
+        }
+    }
 }
 
 }  //namespace
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "imports.hpp"
+
+namespace tiny_pointers {
+
+//=#=#==#==#===============+=+=+=+=++=++++++++++++++-++-+--+-+----+---------------
+// Checking policies select which assertions run on the hot paths of the tables
+// (Allocate, Dereference, Free, Set, Get, bucket lookup, free-list and bit
+// vector access). Checks on construction and other cold paths always run.
+
+/** \brief Runs every hot-path check.
+ */
+struct FullChecks {
+    static constexpr bool kEnabled = true;
+};
+
+/** \brief Runs hot-path checks only in debug builds (when NDEBUG is not
+ * defined).
+ */
+struct DebugChecks {
+#ifdef NDEBUG
+    static constexpr bool kEnabled = false;
+#else
+    static constexpr bool kEnabled = true;
+#endif
+};
+
+/** \brief Compiles all hot-path checks out.
+ */
+struct NoChecks {
+    static constexpr bool kEnabled = false;
+};
+
+// The policy used by the default table instantiations (SimpleDereferenceTable,
+// FunnelDereferenceTable) and by BitVec; set by the TINY_POINTERS_CHECK_POLICY
+// CMake option.
+//
+#ifndef TINY_POINTERS_CHECK_POLICY
+#define TINY_POINTERS_CHECK_POLICY FullChecks
+#endif
+
+using DefaultCheckPolicy = TINY_POINTERS_CHECK_POLICY;
+
+}  //namespace tiny_pointers
+
+//=#=#==#==#===============+=+=+=+=++=++++++++++++++-++-+--+-+----+---------------
+// BATT_CHECK_* that only run if `policy`::kEnabled.
+
+#define TINY_POINTERS_CHECK_IF_(policy, check)                                 \
+    do {                                                                       \
+        if constexpr (policy::kEnabled) {                                      \
+            check;                                                             \
+        }                                                                      \
+    } while (false)
+
+#define TINY_POINTERS_CHECK(policy, x)                                         \
+    TINY_POINTERS_CHECK_IF_(policy, BATT_CHECK(x))
+
+#define TINY_POINTERS_CHECK_EQ(policy, a, b)                                   \
+    TINY_POINTERS_CHECK_IF_(policy, BATT_CHECK_EQ(a, b))
+
+#define TINY_POINTERS_CHECK_NE(policy, a, b)                                   \
+    TINY_POINTERS_CHECK_IF_(policy, BATT_CHECK_NE(a, b))
+
+#define TINY_POINTERS_CHECK_LT(policy, a, b)                                   \
+    TINY_POINTERS_CHECK_IF_(policy, BATT_CHECK_LT(a, b))
+
+#define TINY_POINTERS_CHECK_LE(policy, a, b)                                   \
+    TINY_POINTERS_CHECK_IF_(policy, BATT_CHECK_LE(a, b))
+
+#define TINY_POINTERS_CHECK_GT(policy, a, b)                                   \
+    TINY_POINTERS_CHECK_IF_(policy, BATT_CHECK_GT(a, b))
+
+#define TINY_POINTERS_CHECK_GE(policy, a, b)                                   \
+    TINY_POINTERS_CHECK_IF_(policy, BATT_CHECK_GE(a, b))
@@ -0,0 +1,214 @@
+#pragma once
+
+#include "imports.hpp"
+#include "tiny_pointers.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+#include <vector>
+
+namespace tiny_pointers {
+
+//=#=#==#==#===============+=+=+=+=++=++++++++++++++-++-+--+-+----+---------------
+// Compaction: moving live entries from one table to another (e.g., a fresh or
+// larger table), so that over-full buckets stop causing allocation failures.
+//
+// Tables don't store keys, so the caller supplies the live entries as two
+// parallel ranges: `keys[i]` was allocated tiny pointer `ptrs[i]` in the
+// source table. For each moved entry, the value is copied to a newly
+// allocated slot in the destination table, the old slot is freed, and
+// `on_move(key, old_ptr, new_ptr)` is called so the owner can update its
+// stored pointer.
+//
+// Moved entries live in the destination table afterwards, and the rest stay
+// in the source: unless everything was moved (migrate_all), the owner must
+// keep both tables and remember, per entry, which one to dereference.
+//
+// Entries allocated with a LocalityHint must be migrated with the overloads
+// that take a parallel `hints` range (`hints[i]` is the hint `keys[i]` was
+// allocated with in the source): the hint, not the key, locates such an
+// entry's bucket. Passing hinted entries to the overloads without `hints`
+// reads and frees the wrong slots.
+//
+// A hint is a hash of the parent key, so it is only meaningful to the table
+// that computed it. Those overloads also take `dst_hint(i)`, which returns the
+// hint to re-allocate entry `i` with in the destination: for a hint from
+// `src.locality_hint(parent)`, that is `dst.locality_hint(parent)`, which keeps
+// children in the same bucket as a parent migrated by key. Returning
+// `hints[i]` unchanged is only right if both tables use the same HashFn.
+
+/** \brief The `hints` of the functions below for entries allocated without a
+ * LocalityHint.
+ */
+struct NoLocalityHints {
+};
+
+/** \brief Returns the buckets of `table` that have at least `min_fill` (a
+ * fraction of the bucket size) live slots.
+ */
+template <typename TableT>
+std::vector<usize> find_hot_buckets(const TableT& table, double min_fill)
+{
+    const usize threshold = std::max<usize>(
+        1, (usize)std::ceil(min_fill * (double)table.slots_per_bucket()));
+
+    std::vector<usize> hot;
+    for (usize bucket_i = 0; bucket_i < table.bucket_count(); ++bucket_i) {
+        if (table.bucket_live_count(bucket_i) >= threshold) {
+            hot.push_back(bucket_i);
+        }
+    }
+    return hot;
+}
+
+/** \brief Moves the entries `i` for which `should_move(i)` is true from `src`
+ * to `dst` (see above); returns the number moved. `hints` is either
+ * NoLocalityHints or a range parallel to `keys` of the hints the entries were
+ * allocated with; in the latter case `dst_hint(i)` returns the hint to
+ * allocate entry `i` with in `dst` (and is otherwise unused).
+ *
+ * If `dst` runs out of space, stops and returns kResourceExhausted; the
+ * entries moved (and reported) so far stay moved, and the rest stay in `src`.
+ */
+template <typename SrcTableT, typename DstTableT, typename KeyRange,
+          typename HintRange, typename DstHintFn, typename ShouldMoveFn,
+          typename OnMoveFn>
+StatusOr<usize> migrate_if(SrcTableT& src, DstTableT& dst, const KeyRange& keys,
+                           const HintRange& hints, DstHintFn&& dst_hint,
+                           const std::vector<TinyPointer>& ptrs,
+                           ShouldMoveFn&& should_move, OnMoveFn&& on_move)
+{
+    constexpr bool kHinted = !std::is_same_v<HintRange, NoLocalityHints>;
+
+    BATT_CHECK_EQ(keys.size(), ptrs.size());
+    if constexpr (kHinted) {
+        BATT_CHECK_EQ(keys.size(), hints.size());
+    }
+
+    usize moved = 0;
+    for (usize i = 0; i < keys.size(); ++i) {
+        if (!should_move(i)) {
+            continue;
+        }
+        const Key key = keys[i];
+
+        if constexpr (kHinted) {
+            const LocalityHint src_hint{hints[i]};
+            const LocalityHint new_hint{dst_hint(i)};
+
+            StatusOr<TinyPointer> new_ptr = dst.Allocate(key, new_hint);
+            BATT_REQUIRE_OK(new_ptr);
+
+            dst.Set(dst.Dereference(key, new_hint, *new_ptr),
+                    src.Get(src.Dereference(key, src_hint, ptrs[i])));
+            src.Free(key, src_hint, ptrs[i]);
+
+            on_move(key, ptrs[i], *new_ptr);
+        } else {
+            StatusOr<TinyPointer> new_ptr = dst.Allocate(key);
+            BATT_REQUIRE_OK(new_ptr);
+
+            dst.Set(dst.Dereference(key, *new_ptr),
+                    src.Get(src.Dereference(key, ptrs[i])));
+            src.Free(key, ptrs[i]);
+
+            on_move(key, ptrs[i], *new_ptr);
+        }
+        ++moved;
+    }
+    return moved;
+}
+
+/** \brief migrate_if for entries allocated without a LocalityHint.
+ */
+template <typename SrcTableT, typename DstTableT, typename KeyRange,
+          typename ShouldMoveFn, typename OnMoveFn>
+StatusOr<usize> migrate_if(SrcTableT& src, DstTableT& dst, const KeyRange& keys,
+                           const std::vector<TinyPointer>& ptrs,
+                           ShouldMoveFn&& should_move, OnMoveFn&& on_move)
+{
+    return migrate_if(src, dst, keys, NoLocalityHints{}, NoLocalityHints{}, ptrs,
+                      should_move, on_move);
+}
+
+/** \brief Moves every entry in a bucket of `src` with at least `min_fill` live
+ * slots (see find_hot_buckets) to `dst`; returns the number moved. The other
+ * entries, and their tiny pointers, are untouched. `hints` and `dst_hint` are
+ * as for migrate_if.
+ */
+template <typename SrcTableT, typename DstTableT, typename KeyRange,
+          typename HintRange, typename DstHintFn, typename OnMoveFn>
+StatusOr<usize> migrate_hot_buckets(SrcTableT& src, DstTableT& dst,
+                                    const KeyRange& keys,
+                                    const HintRange& hints,
+                                    DstHintFn&& dst_hint,
+                                    const std::vector<TinyPointer>& ptrs,
+                                    double min_fill, OnMoveFn&& on_move)
+{
+    // Decide which buckets are hot before moving anything, since moving
+    // entries out of a bucket cools it down.
+    //
+    std::vector<bool> hot(src.bucket_count(), false);
+    for (usize bucket_i : find_hot_buckets(src, min_fill)) {
+        hot[bucket_i] = true;
+    }
+
+    return migrate_if(
+        src, dst, keys, hints, dst_hint, ptrs,
+        [&](usize i) {
+            if constexpr (std::is_same_v<HintRange, NoLocalityHints>) {
+                return hot[src.find_bucket(Key{keys[i]})];
+            } else {
+                return hot[src.find_bucket(LocalityHint{hints[i]})];
+            }
+        },
+        on_move);
+}
+
+/** \brief migrate_hot_buckets for entries allocated without a LocalityHint.
+ */
+template <typename SrcTableT, typename DstTableT, typename KeyRange,
+          typename OnMoveFn>
+StatusOr<usize> migrate_hot_buckets(SrcTableT& src, DstTableT& dst,
+                                    const KeyRange& keys,
+                                    const std::vector<TinyPointer>& ptrs,
+                                    double min_fill, OnMoveFn&& on_move)
+{
+    return migrate_hot_buckets(src, dst, keys, NoLocalityHints{},
+                               NoLocalityHints{}, ptrs, min_fill, on_move);
+}
+
+/** \brief Moves every entry from `src` to `dst` (e.g., to resize a table);
+ * returns the number moved. `hints` and `dst_hint` are as for migrate_if.
+ */
+template <typename SrcTableT, typename DstTableT, typename KeyRange,
+          typename HintRange, typename DstHintFn, typename OnMoveFn>
+StatusOr<usize> migrate_all(SrcTableT& src, DstTableT& dst,
+                            const KeyRange& keys, const HintRange& hints,
+                            DstHintFn&& dst_hint,
+                            const std::vector<TinyPointer>& ptrs,
+                            OnMoveFn&& on_move)
+{
+    return migrate_if(
+        src, dst, keys, hints, dst_hint, ptrs,
+        [](usize) {
+            return true;
+        },
+        on_move);
+}
+
+/** \brief migrate_all for entries allocated without a LocalityHint.
+ */
+template <typename SrcTableT, typename DstTableT, typename KeyRange,
+          typename OnMoveFn>
+StatusOr<usize> migrate_all(SrcTableT& src, DstTableT& dst,
+                            const KeyRange& keys,
+                            const std::vector<TinyPointer>& ptrs,
+                            OnMoveFn&& on_move)
+{
+    return migrate_all(src, dst, keys, NoLocalityHints{}, NoLocalityHints{},
+                       ptrs, on_move);
+}
+
+}  //namespace tiny_pointers
@@ -0,0 +1,234 @@
+#include <tiny_pointers/compaction.hpp>
+//
+#include <tiny_pointers/compaction.hpp>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <tiny_pointers/funnel_dereference_table.hpp>
+
+#include <string>
+#include <vector>
+
+namespace {
+
+using namespace batt::int_types;
+using tiny_pointers::BitsPerSlot;
+using tiny_pointers::BitVec;
+using tiny_pointers::Delta;
+using tiny_pointers::find_hot_buckets;
+using tiny_pointers::FunnelDereferenceTable;
+using tiny_pointers::HashFn;
+using tiny_pointers::Key;
+using tiny_pointers::LocalityHint;
+using tiny_pointers::migrate_all;
+using tiny_pointers::migrate_hot_buckets;
+using tiny_pointers::SimpleDereferenceTable;
+using tiny_pointers::SlotCount;
+using tiny_pointers::StatusOr;
+using tiny_pointers::TinyPointer;
+
+//==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+//
+TEST(CompactionTest, MigrateHotBuckets)
+{
+    SimpleDereferenceTable src{SlotCount{1000000}, BitsPerSlot{64}};
+    SimpleDereferenceTable dst{SlotCount{1000000}, BitsPerSlot{64}};
+
+    // Fill `src` until some bucket is full.
+    //
+    std::vector<std::string> keys;
+    std::vector<TinyPointer> ptrs;
+    std::string failed_key;
+    for (usize i = 0;; ++i) {
+        std::string key = std::to_string(i);
+        StatusOr<TinyPointer> p = src.Allocate(key);
+        if (!p.ok()) {
+            failed_key = std::move(key);
+            break;
+        }
+        src.Set(src.Dereference(key, *p), BitVec{64, i});
+        keys.emplace_back(std::move(key));
+        ptrs.emplace_back(std::move(*p));
+    }
+
+    const std::vector<usize> hot = find_hot_buckets(src, 1.0);
+    ASSERT_FALSE(hot.empty());
+    EXPECT_EQ(src.find_bucket(failed_key), hot.front());
+
+    const usize size_before = src.size();
+
+    // The owner's view: which table each key lives in, and its pointer.
+    //
+    std::vector<bool> moved(keys.size(), false);
+    usize callbacks = 0;
+
+    StatusOr<usize> n_moved = migrate_hot_buckets(
+        src, dst, keys, ptrs, 1.0,
+        [&](Key key, const TinyPointer& old_ptr, const TinyPointer& new_ptr) {
+            const usize i = std::stoull(std::string{key});
+            EXPECT_EQ(old_ptr.int_value(), ptrs[i].int_value());
+            moved[i] = true;
+            ptrs[i] = new_ptr;
+            ++callbacks;
+        });
+
+    ASSERT_TRUE(n_moved.ok());
+    EXPECT_EQ(*n_moved, callbacks);
+    EXPECT_EQ(*n_moved, hot.size() * src.slots_per_bucket());
+    EXPECT_EQ(src.size(), size_before - *n_moved);
+    EXPECT_EQ(dst.size(), *n_moved);
+    for (usize bucket_i : hot) {
+        EXPECT_EQ(src.bucket_live_count(bucket_i), 0u);
+    }
+
+    // Every entry still has its value, in whichever table it lives in now.
+    //
+    for (usize i = 0; i < keys.size(); ++i) {
+        SimpleDereferenceTable& table = moved[i] ? dst : src;
+        ASSERT_EQ(table.Get(table.Dereference(keys[i], ptrs[i])).int_value(),
+                  i);
+    }
+
+    // The key that didn't fit before now does.
+    //
+    EXPECT_TRUE(src.Allocate(failed_key).ok());
+}
+
+//==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+//
+TEST(CompactionTest, MigrateAllToResizedTable)
+{
+    SimpleDereferenceTable src{SlotCount{100000}, BitsPerSlot{64}};
+    FunnelDereferenceTable dst{SlotCount{400000}, BitsPerSlot{64},
+                               Delta{1.0 / 64}};
+
+    std::vector<std::string> keys;
+    std::vector<TinyPointer> ptrs;
+    for (usize i = 0; i < 50000; ++i) {
+        keys.emplace_back(std::to_string(i));
+        StatusOr<TinyPointer> p = src.Allocate(keys.back());
+        ASSERT_TRUE(p.ok());
+        src.Set(src.Dereference(keys.back(), *p), BitVec{64, i});
+        ptrs.emplace_back(std::move(*p));
+    }
+
+    std::vector<TinyPointer> new_ptrs(keys.size());
+    StatusOr<usize> n_moved = migrate_all(
+        src, dst, keys, ptrs,
+        [&](Key key, const TinyPointer&, const TinyPointer& new_ptr) {
+            new_ptrs[std::stoull(std::string{key})] = new_ptr;
+        });
+
+    ASSERT_TRUE(n_moved.ok());
+    EXPECT_EQ(*n_moved, keys.size());
+    EXPECT_EQ(src.size(), 0u);
+    EXPECT_EQ(dst.size(), keys.size());
+
+    for (usize i = 0; i < keys.size(); ++i) {
+        EXPECT_EQ(dst.Get(dst.Dereference(keys[i], new_ptrs[i])).int_value(),
+                  i);
+    }
+
+    // Moving into a table that is too small stops partway, consistently.
+    //
+    SimpleDereferenceTable small{SlotCount{10000}, BitsPerSlot{64}};
+    usize reported = 0;
+    StatusOr<usize> partial = migrate_all(
+        dst, small, keys, new_ptrs,
+        [&](Key, const TinyPointer&, const TinyPointer&) {
+            ++reported;
+        });
+
+    EXPECT_EQ(partial.status(), batt::StatusCode::kResourceExhausted);
+    EXPECT_EQ(small.size(), reported);
+    EXPECT_EQ(dst.size() + small.size(), keys.size());
+}
+
+//==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+//
+TEST(CompactionTest, MigrateHintedEntries)
+{
+    // The tables hash differently, so a hint computed by `src` means nothing
+    // to `dst`. (The seeds are fixed so that "parent" lands in different
+    // buckets of the two.)
+    //
+    SimpleDereferenceTable src{SlotCount{1 << 20}, BitsPerSlot{32}, HashFn{1}};
+    SimpleDereferenceTable dst{SlotCount{1 << 20}, BitsPerSlot{32}, HashFn{3}};
+
+    // A parent allocated by key, and children allocated next to it; fill the
+    // parent's bucket with them so that it is hot, while each child's own key
+    // hashes elsewhere.
+    //
+    const std::string parent = "parent";
+    StatusOr<TinyPointer> parent_ptr = src.Allocate(parent);
+    ASSERT_TRUE(parent_ptr.ok());
+    src.Set(src.Dereference(parent, *parent_ptr), BitVec{32, 12345});
+
+    const LocalityHint hint = src.locality_hint(parent);
+    const usize hinted_bucket = src.find_bucket(hint);
+    ASSERT_EQ(hinted_bucket, src.find_bucket(Key{parent}));
+
+    std::vector<std::string> keys;
+    std::vector<LocalityHint> hints;
+    std::vector<TinyPointer> ptrs;
+    for (usize i = 0;; ++i) {
+        std::string key = "child" + std::to_string(i);
+        StatusOr<TinyPointer> p = src.Allocate(key, hint);
+        if (!p.ok()) {
+            break;
+        }
+        src.Set(src.Dereference(key, hint, *p), BitVec{32, i});
+        keys.emplace_back(std::move(key));
+        hints.emplace_back(hint);
+        ptrs.emplace_back(std::move(*p));
+    }
+    ASSERT_EQ(src.bucket_live_count(hinted_bucket), src.slots_per_bucket());
+
+    // Move the children, re-deriving their hint from the parent in `dst`, and
+    // then the parent, by key.
+    //
+    const LocalityHint new_hint = dst.locality_hint(parent);
+    EXPECT_NE(dst.find_bucket(new_hint), dst.find_bucket(hint));
+
+    std::vector<TinyPointer> new_ptrs(keys.size());
+    StatusOr<usize> n_moved = migrate_hot_buckets(
+        src, dst, keys, hints,
+        [&](usize) {
+            return new_hint;
+        },
+        ptrs, 1.0,
+        [&](Key key, const TinyPointer&, const TinyPointer& new_ptr) {
+            new_ptrs[std::stoull(std::string{key}.substr(5))] = new_ptr;
+        });
+
+    ASSERT_TRUE(n_moved.ok());
+    EXPECT_EQ(*n_moved, keys.size());
+
+    TinyPointer new_parent_ptr;
+    n_moved = migrate_all(
+        src, dst, std::vector<std::string>{parent}, {*parent_ptr},
+        [&](Key, const TinyPointer&, const TinyPointer& new_ptr) {
+            new_parent_ptr = new_ptr;
+        });
+
+    ASSERT_TRUE(n_moved.ok());
+    EXPECT_EQ(*n_moved, 1u);
+    EXPECT_EQ(src.size(), 0u);
+    EXPECT_EQ(src.bucket_live_count(hinted_bucket), 0u);
+
+    // The parent and its children still share a bucket, and have their values.
+    //
+    const usize parent_bucket = dst.find_bucket(Key{parent});
+    EXPECT_EQ(parent_bucket, dst.find_bucket(new_hint));
+    EXPECT_EQ(dst.bucket_live_count(parent_bucket), keys.size() + 1);
+    EXPECT_EQ(dst.Get(dst.Dereference(parent, new_parent_ptr)).int_value(),
+              12345u);
+    for (usize i = 0; i < keys.size(); ++i) {
+        EXPECT_EQ(dst.Get(dst.Dereference(keys[i], new_hint, new_ptrs[i]))
+                      .int_value(),
+                  i);
+    }
+}
+
+}  // namespace
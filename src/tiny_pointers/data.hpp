@@ -1,15 +1,24 @@
 #pragma once
 
 #include "imports.hpp"
+#include "parallel.hpp"
 
 #include <boost/algorithm/string.hpp>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <algorithm>
 #include <cctype>
+#include <cerrno>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <random>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace tiny_pointers {
@@ -75,19 +84,269 @@ inline std::string random_key(std::default_random_engine& rng, usize word_count
         tiny_pointers::load_words_rel(std::filesystem::path{"data"} / "words");
     static std::uniform_int_distribution<usize> pick_word{0, words.size() - 1};
 
-    std::ostringstream oss;
-    bool first = true;
-
+    std::string key;
     for (usize i = 0; i < word_count; ++i) {
-        if (!first) {
-            oss << " ";
-        } else {
-            first = false;
+        if (i != 0) {
+            key += ' ';
+        }
+        key += words[pick_word(rng)];
+    }
+
+    return key;
+}
+
+//=#=#==#==#===============+=+=+=+=++=++++++++++++++-++-+--+-+----+---------------
+
+/** \brief A list of keys stored back-to-back in one contiguous buffer, so that iterating over (or
+ * generating) many keys doesn't allocate per key or chase pointers.
+ */
+class KeyArena
+{
+   public:
+    KeyArena() = default;
+
+    void reserve(usize key_count, usize byte_count)
+    {
+        this->offsets_.reserve(key_count + 1);
+        this->bytes_.reserve(byte_count);
+    }
+
+    /** \brief Appends `key`; returns its index.
+     */
+    usize push_back(std::string_view key)
+    {
+        this->bytes_.append(key);
+        this->offsets_.push_back(this->bytes_.size());
+        return this->offsets_.size() - 2;
+    }
+
+    /** \brief Appends the concatenation of `parts`, separated by `sep`; returns its index.
+     */
+    usize push_back_joined(const std::vector<std::string_view>& parts, char sep)
+    {
+        for (usize i = 0; i < parts.size(); ++i) {
+            if (i != 0) {
+                this->bytes_ += sep;
+            }
+            this->bytes_.append(parts[i]);
+        }
+        this->offsets_.push_back(this->bytes_.size());
+        return this->offsets_.size() - 2;
+    }
+
+    /** \brief Appends all the keys of `other`, in order.
+     */
+    void append(const KeyArena& other)
+    {
+        const usize base = this->bytes_.size();
+
+        this->bytes_.append(other.bytes_);
+        this->offsets_.reserve(this->offsets_.size() + other.size());
+        for (usize i = 1; i < other.offsets_.size(); ++i) {
+            this->offsets_.push_back(base + other.offsets_[i]);
+        }
+    }
+
+    void clear()
+    {
+        this->bytes_.clear();
+        this->offsets_.resize(1);
+    }
+
+    /** \brief The number of keys.
+     */
+    usize size() const
+    {
+        return this->offsets_.size() - 1;
+    }
+
+    bool empty() const
+    {
+        return this->size() == 0;
+    }
+
+    /** \brief The total length of all keys, in bytes.
+     */
+    usize byte_size() const
+    {
+        return this->bytes_.size();
+    }
+
+    std::string_view operator[](usize i) const
+    {
+        BATT_CHECK_LT(i, this->size());
+
+        return std::string_view{this->bytes_}.substr(this->offsets_[i],
+                                                     this->offsets_[i + 1] - this->offsets_[i]);
+    }
+
+    const std::string& bytes() const
+    {
+        return this->bytes_;
+    }
+
+    /** \brief offsets()[i] is the position in bytes() where key `i` starts; there is one more offset
+     * than there are keys.
+     */
+    const std::vector<usize>& offsets() const
+    {
+        return this->offsets_;
+    }
+
+    /** \brief Replaces the contents of this arena; `offsets` must start with 0, be non-decreasing, and
+     * end with `bytes.size()`.
+     */
+    void assign(std::string bytes, std::vector<usize> offsets)
+    {
+        BATT_CHECK(!offsets.empty());
+        BATT_CHECK_EQ(offsets.front(), 0u);
+        BATT_CHECK_EQ(offsets.back(), bytes.size());
+        BATT_CHECK(std::is_sorted(offsets.begin(), offsets.end()));
+
+        this->bytes_ = std::move(bytes);
+        this->offsets_ = std::move(offsets);
+    }
+
+   private:
+    std::string bytes_;
+    std::vector<usize> offsets_{0};
+};
+
+//=#=#==#==#===============+=+=+=+=++=++++++++++++++-++-+--+-+----+---------------
+
+/** \brief A read-only memory mapping of a whole file.
+ */
+class MappedFile
+{
+   public:
+    explicit MappedFile(const std::filesystem::path& file_path)
+    {
+        const int fd = ::open(file_path.c_str(), O_RDONLY);
+        BATT_CHECK_GE(fd, 0) << BATT_INSPECT(file_path) << std::strerror(errno);
+
+        struct stat st;
+        BATT_CHECK_EQ(::fstat(fd, &st), 0) << BATT_INSPECT(file_path) << std::strerror(errno);
+        this->size_ = st.st_size;
+
+        // mmap doesn't allow empty mappings.
+        //
+        if (this->size_ != 0) {
+            void* const data = ::mmap(nullptr, this->size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            BATT_CHECK_NE(data, MAP_FAILED) << BATT_INSPECT(file_path) << std::strerror(errno);
+
+            this->data_ = static_cast<const char*>(data);
+            ::madvise(data, this->size_, MADV_SEQUENTIAL);
+        }
+        ::close(fd);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile()
+    {
+        if (this->data_ != nullptr) {
+            ::munmap(const_cast<char*>(this->data_), this->size_);
+        }
+    }
+
+    std::string_view bytes() const
+    {
+        return std::string_view{this->data_, this->size_};
+    }
+
+   private:
+    const char* data_ = nullptr;
+    usize size_ = 0;
+};
+
+/** \brief Appends the tokens of `text` to `words`, normalized as by load_words: split on
+ * whitespace, lowercased, and with everything but alphanumeric characters removed; empty tokens are
+ * dropped.
+ */
+inline void tokenize_words(std::string_view text, KeyArena& words)
+{
+    const auto is_space = [](char ch) {
+        return std::isspace((unsigned char)ch);
+    };
+
+    std::string token;
+    usize i = 0;
+    while (i < text.size()) {
+        while (i < text.size() && is_space(text[i])) {
+            ++i;
+        }
+        token.clear();
+        for (; i < text.size() && !is_space(text[i]); ++i) {
+            const unsigned char ch = text[i];
+            if (std::isalnum(ch)) {
+                token += (char)std::tolower(ch);
+            }
+        }
+        if (!token.empty()) {
+            words.push_back(token);
+        }
+    }
+}
+
+/** \brief Tokenizes `text` (see tokenize_words) using `n_threads` threads, each working on a
+ * contiguous chunk that starts and ends on a token boundary. If `n_threads` is 0, uses up to one
+ * thread per core, but no more than one per MiB of text.
+ */
+inline KeyArena tokenize_words_parallel(std::string_view text, usize n_threads = 0)
+{
+    constexpr usize kMinChunkBytes = usize{1} << 20;
+
+    if (n_threads == 0) {
+        n_threads = std::min(default_thread_count(), std::max<usize>(1, text.size() / kMinChunkBytes));
+    }
+
+    // Move each chunk boundary forward to the start of a token.
+    //
+    std::vector<usize> chunk_begin(n_threads + 1);
+    for (usize chunk_i = 0; chunk_i <= n_threads; ++chunk_i) {
+        usize pos = split_range(text.size(), n_threads, chunk_i).first;
+        while (pos > 0 && pos < text.size() && !std::isspace((unsigned char)text[pos - 1])) {
+            ++pos;
         }
-        oss << words[pick_word(rng)];
+        chunk_begin[chunk_i] = pos;
     }
 
-    return std::move(oss).str();
+    std::vector<KeyArena> chunks(n_threads);
+    run_parallel(n_threads, [&](usize chunk_i) {
+        tokenize_words(text.substr(chunk_begin[chunk_i], chunk_begin[chunk_i + 1] - chunk_begin[chunk_i]),
+                       chunks[chunk_i]);
+    });
+
+    KeyArena words = std::move(chunks[0]);
+    for (usize chunk_i = 1; chunk_i < n_threads; ++chunk_i) {
+        words.append(chunks[chunk_i]);
+    }
+    return words;
+}
+
+/** \brief Same as load_words, but memory-maps the file and tokenizes it in parallel chunks (see
+ * tokenize_words_parallel); the words are appended to `words`.
+ */
+inline void load_words_mapped(std::filesystem::path file_path, KeyArena& words, usize n_threads = 0)
+{
+    const MappedFile file{file_path};
+
+    if (words.empty()) {
+        words = tokenize_words_parallel(file.bytes(), n_threads);
+    } else {
+        words.append(tokenize_words_parallel(file.bytes(), n_threads));
+    }
+}
+
+/** \brief Same as load_words_mapped, but path is relative to this project's git repo root dir.
+ */
+inline void load_words_mapped_rel(std::filesystem::path rel_file_path, KeyArena& words,
+                                  usize n_threads = 0)
+{
+    load_words_mapped(
+        std::filesystem::path{__FILE__}.parent_path().parent_path().parent_path() / rel_file_path, words,
+        n_threads);
 }
 
 }  //namespace tiny_pointers
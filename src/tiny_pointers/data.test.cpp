@@ -9,6 +9,8 @@
 
 namespace {
 
+using namespace batt::int_types;
+
 TEST(DataTest, Load)
 {
     auto data_dir = std::filesystem::path{"data"};
@@ -29,4 +31,71 @@ TEST(DataTest, Load)
     std::cerr << BATT_INSPECT(words.size()) << BATT_INSPECT(word_set.size()) << std::endl;
 }
 
+TEST(DataTest, KeyArena)
+{
+    tiny_pointers::KeyArena arena;
+
+    EXPECT_TRUE(arena.empty());
+    EXPECT_EQ(arena.push_back("apple"), 0u);
+    EXPECT_EQ(arena.push_back(""), 1u);
+    EXPECT_EQ(arena.push_back_joined({"banana", "split"}, ' '), 2u);
+
+    EXPECT_EQ(arena.size(), 3u);
+    EXPECT_EQ(arena.byte_size(), 17u);
+    EXPECT_EQ(arena[0], "apple");
+    EXPECT_EQ(arena[1], "");
+    EXPECT_EQ(arena[2], "banana split");
+
+    tiny_pointers::KeyArena copy;
+    copy.assign(arena.bytes(), arena.offsets());
+    EXPECT_EQ(copy[2], "banana split");
+
+    arena.clear();
+    EXPECT_TRUE(arena.empty());
+    EXPECT_EQ(arena.byte_size(), 0u);
+}
+
+TEST(DataTest, TokenizeWords)
+{
+    tiny_pointers::KeyArena words;
+    tiny_pointers::tokenize_words("  Hello, World!\n\tfoo-bar 42 ... \xe9t\xe9 x", words);
+
+    ASSERT_EQ(words.size(), 6u);
+    EXPECT_EQ(words[0], "hello");
+    EXPECT_EQ(words[1], "world");
+    EXPECT_EQ(words[2], "foobar");
+    EXPECT_EQ(words[3], "42");
+    EXPECT_EQ(words[4], "t");
+    EXPECT_EQ(words[5], "x");
+
+    // Every chunking gives the same result.
+    //
+    const std::string_view text = "aa bb cc\ndd  ee ff gg hh ii jj";
+    for (usize n_threads : {1, 2, 3, 7, 16}) {
+        const tiny_pointers::KeyArena chunked = tiny_pointers::tokenize_words_parallel(text, n_threads);
+        ASSERT_EQ(chunked.size(), 10u) << BATT_INSPECT(n_threads);
+        EXPECT_EQ(chunked.bytes(), "aabbccddeeffgghhiijj");
+    }
+}
+
+TEST(DataTest, LoadWordsMapped)
+{
+    auto data_dir = std::filesystem::path{"data"};
+
+    for (auto rel_path : {data_dir / "words", data_dir / "calgary" / "bib", data_dir / "calgary" / "book1",
+                          data_dir / "calgary" / "news", data_dir / "calgary" / "progc"}) {
+        const std::vector<std::string> expected = tiny_pointers::load_words_rel(rel_path);
+
+        for (usize n_threads : {0, 1, 4}) {
+            tiny_pointers::KeyArena words;
+            tiny_pointers::load_words_mapped_rel(rel_path, words, n_threads);
+
+            ASSERT_EQ(words.size(), expected.size()) << BATT_INSPECT(rel_path) << BATT_INSPECT(n_threads);
+            for (usize i = 0; i < words.size(); ++i) {
+                ASSERT_EQ(words[i], expected[i]) << BATT_INSPECT(rel_path) << BATT_INSPECT(i);
+            }
+        }
+    }
+}
+
 }  //namespace
@@ -0,0 +1,287 @@
+#pragma once
+
+#include "imports.hpp"
+#include "parallel.hpp"
+#include "tiny_pointers.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+#include <optional>
+#include <ostream>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace tiny_pointers {
+
+//=#=#==#==#===============+=+=+=+=++=++++++++++++++-++-+--+-+----+---------------
+
+/** \brief The table parameters for one point of a sweep.
+ */
+struct ExperimentConfig {
+    SlotCount n;
+    BitsPerSlot q;
+    Delta delta;
+
+    // The number of independent trials (tables filled to failure).
+    //
+    usize trials;
+};
+
+/** \brief Returns the cartesian product of `ns`, `qs`, and `deltas`, each with
+ * `trials` trials.
+ */
+inline std::vector<ExperimentConfig> make_sweep(
+    const std::vector<SlotCount>& ns, const std::vector<BitsPerSlot>& qs,
+    const std::vector<Delta>& deltas, usize trials)
+{
+    std::vector<ExperimentConfig> configs;
+    for (SlotCount n : ns) {
+        for (BitsPerSlot q : qs) {
+            for (Delta delta : deltas) {
+                configs.push_back(ExperimentConfig{n, q, delta, trials});
+            }
+        }
+    }
+    return configs;
+}
+
+/** \brief The outcome of one trial: a fresh table, filled until an allocation
+ * fails (or every slot is allocated).
+ */
+struct TrialResult {
+    // The number of allocations that succeeded.
+    //
+    usize size_reached;
+
+    // True if an allocation failed before capacity() allocations.
+    //
+    bool failed_early;
+};
+
+/** \brief The aggregated results of all trials for one ExperimentConfig.
+ */
+struct ExperimentResult {
+    ExperimentConfig config;
+
+    // The table geometry (the same for every trial).
+    //
+    usize n_slots = 0;
+    usize capacity = 0;
+    usize tiny_pointer_bits = 0;
+
+    // The δ the table uses (see table_delta), or nullopt for tables that
+    // ignore δ, such as SimpleDereferenceTable.
+    //
+    std::optional<double> delta;
+
+    // The memory used by trial 0's table once it was filled.
+    //
+    MemoryFootprint footprint;
+
+    // size_reached / n_slots for each trial, sorted.
+    //
+    std::vector<double> load_factors;
+
+    // The fraction of trials with an allocation failure before capacity.
+    //
+    double failure_probability = 0;
+
+    /** \brief Returns the `fraction`-quantile of the achieved load factors.
+     */
+    double load_factor_quantile(double fraction) const noexcept
+    {
+        BATT_CHECK(!this->load_factors.empty());
+
+        const usize i = std::min<usize>(
+            this->load_factors.size() - 1,
+            (usize)(fraction * (double)this->load_factors.size()));
+
+        return this->load_factors[i];
+    }
+
+    double mean_load_factor() const noexcept
+    {
+        return std::accumulate(this->load_factors.begin(),
+                               this->load_factors.end(), 0.0) /
+               (double)std::max<usize>(1, this->load_factors.size());
+    }
+};
+
+//=#=#==#==#===============+=+=+=+=++=++++++++++++++-++-+--+-+----+---------------
+
+/** \brief Returns `table`.delta() if the table type has a δ parameter, else
+ * nullopt.
+ */
+template <typename TableT>
+std::optional<double> table_delta(const TableT& table)
+{
+    if constexpr (requires { table.delta(); }) {
+        return table.delta();
+    } else {
+        return std::nullopt;
+    }
+}
+
+/** \brief Fills `table` with distinct 8-byte keys (derived from `key_seed`)
+ * until an allocation fails or every slot is allocated.
+ */
+template <typename TableT>
+TrialResult run_trial(TableT& table, u64 key_seed)
+{
+    for (u64 k = 0; k < table.n_slots(); ++k) {
+        // mix_u64 is a bijection, so the keys are distinct.
+        //
+        const u64 key = mix_u64(key_seed + k);
+        if (!table.Allocate(Key{(const char*)&key, sizeof(key)}).ok()) {
+            break;
+        }
+    }
+
+    return TrialResult{
+        .size_reached = table.size(),
+        .failed_early = table.size() < table.capacity(),
+    };
+}
+
+/** \brief Runs all trials of all `configs` on a pool of `n_threads` threads
+ * (0 means one per core), and returns one result per config.
+ *
+ * `make_table(config, hash_fn)` must return a (smart) pointer to a new table
+ * that hashes with `hash_fn`, with Allocate, size, n_slots, capacity,
+ * tiny_pointer_size, and footprint; e.g.,
+ * `std::make_unique<FunnelDereferenceTable>(c.n, c.q, c.delta, hash_fn)`. Each
+ * thread holds one table at a time, so peak memory is about n_threads tables.
+ *
+ * Trial `t` of config `i` uses keys and a HashFn both derived from `seed`,
+ * `i`, and `t`, so sweeps with the same `seed` give the same results.
+ */
+template <typename MakeTableFn>
+std::vector<ExperimentResult> run_sweep(
+    const std::vector<ExperimentConfig>& configs, MakeTableFn&& make_table,
+    usize n_threads = 0, u64 seed = 0)
+{
+    // Flatten the (config, trial) pairs so all threads stay busy until the
+    // very end, even when configs have few trials.
+    //
+    std::vector<std::pair<usize, usize>> work;
+    for (usize config_i = 0; config_i < configs.size(); ++config_i) {
+        for (usize trial_i = 0; trial_i < configs[config_i].trials; ++trial_i) {
+            work.emplace_back(config_i, trial_i);
+        }
+    }
+
+    std::vector<ExperimentResult> results(configs.size());
+    std::vector<std::vector<TrialResult>> trials(configs.size());
+    for (usize config_i = 0; config_i < configs.size(); ++config_i) {
+        results[config_i].config = configs[config_i];
+        trials[config_i].resize(configs[config_i].trials);
+    }
+
+    n_threads = std::max<usize>(
+        1, std::min(default_thread_count(n_threads), work.size()));
+
+    std::atomic<usize> next_work{0};
+
+    run_parallel(n_threads, [&](usize) {
+        for (;;) {
+            const usize work_i = next_work.fetch_add(1);
+            if (work_i >= work.size()) {
+                break;
+            }
+            const auto [config_i, trial_i] = work[work_i];
+
+            // The keys are mix_u64(trial_seed + k), so the hash seed is
+            // derived from the complement to keep it apart from them.
+            //
+            const u64 trial_seed = mix_u64(seed + mix_u64(config_i) + trial_i);
+
+            auto table = make_table(configs[config_i],
+                                    HashFn{mix_u64(~trial_seed)});
+
+            trials[config_i][trial_i] = run_trial(*table, trial_seed);
+
+            // Every trial of a config has the same geometry, so whichever
+            // thread runs trial 0 records it.
+            //
+            if (trial_i == 0) {
+                ExperimentResult& result = results[config_i];
+                result.n_slots = table->n_slots();
+                result.capacity = table->capacity();
+                result.tiny_pointer_bits = table->tiny_pointer_size();
+                result.delta = table_delta(*table);
+                result.footprint = table->footprint();
+            }
+        }
+    });
+
+    for (usize config_i = 0; config_i < configs.size(); ++config_i) {
+        ExperimentResult& result = results[config_i];
+        usize failures = 0;
+
+        for (const TrialResult& trial : trials[config_i]) {
+            result.load_factors.push_back((double)trial.size_reached /
+                                          (double)result.n_slots);
+            failures += trial.failed_early;
+        }
+        std::sort(result.load_factors.begin(), result.load_factors.end());
+
+        result.failure_probability =
+            (double)failures /
+            (double)std::max<usize>(1, trials[config_i].size());
+    }
+
+    return results;
+}
+
+//=#=#==#==#===============+=+=+=+=++=++++++++++++++-++-+--+-+----+---------------
+
+inline void write_csv_header(std::ostream& out)
+{
+    out << "n,q,delta,trials,n_slots,capacity,tiny_pointer_bits,"
+           "load_factor_min,load_factor_p10,load_factor_p50,load_factor_p90,"
+           "load_factor_max,load_factor_mean,failure_probability,storage_bytes,"
+           "metadata_bytes,bytes_per_entry,net_bytes_saved\n";
+}
+
+inline void write_csv_row(std::ostream& out, const ExperimentResult& result)
+{
+    out << result.config.n << "," << result.config.q << ",";
+    if (result.delta) {
+        out << *result.delta;
+    }
+    out << "," << result.config.trials << ","
+        << result.n_slots << "," << result.capacity << ","
+        << result.tiny_pointer_bits;
+
+    if (result.load_factors.empty()) {
+        out << ",,,,,,";
+    } else {
+        out << "," << result.load_factors.front() << ","
+            << result.load_factor_quantile(0.1) << ","
+            << result.load_factor_quantile(0.5) << ","
+            << result.load_factor_quantile(0.9) << ","
+            << result.load_factors.back() << ","
+            << result.mean_load_factor();
+    }
+    out << "," << result.failure_probability << ","
+        << result.footprint.storage_bytes << ","
+        << result.footprint.metadata_bytes << ","
+        << result.footprint.bytes_per_live_entry() << ","
+        << result.footprint.net_bytes_saved() << "\n";
+}
+
+/** \brief Writes `results` as CSV, with a header row.
+ */
+inline void write_csv(std::ostream& out,
+                      const std::vector<ExperimentResult>& results)
+{
+    write_csv_header(out);
+    for (const ExperimentResult& result : results) {
+        write_csv_row(out, result);
+    }
+}
+
+}  //namespace tiny_pointers
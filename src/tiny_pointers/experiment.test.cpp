@@ -0,0 +1,143 @@
+#include <tiny_pointers/experiment.hpp>
+//
+#include <tiny_pointers/experiment.hpp>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <tiny_pointers/funnel_dereference_table.hpp>
+
+#include <algorithm>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+using namespace batt::int_types;
+using tiny_pointers::BitsPerSlot;
+using tiny_pointers::Delta;
+using tiny_pointers::ExperimentConfig;
+using tiny_pointers::ExperimentResult;
+using tiny_pointers::FunnelDereferenceTable;
+using tiny_pointers::HashFn;
+using tiny_pointers::make_sweep;
+using tiny_pointers::run_sweep;
+using tiny_pointers::SimpleDereferenceTable;
+using tiny_pointers::SlotCount;
+using tiny_pointers::write_csv;
+
+std::unique_ptr<FunnelDereferenceTable> make_funnel_table(
+    const ExperimentConfig& c, HashFn hash_fn)
+{
+    return std::make_unique<FunnelDereferenceTable>(c.n, c.q, c.delta,
+                                                    std::move(hash_fn));
+}
+
+//==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+//
+TEST(ExperimentTest, SimpleDereferenceTable)
+{
+    const std::vector<ExperimentConfig> configs =
+        make_sweep({SlotCount{100000}, SlotCount{1000000}}, {BitsPerSlot{64}},
+                   {Delta{0}}, /*trials=*/16);
+
+    ASSERT_EQ(configs.size(), 2u);
+
+    const std::vector<ExperimentResult> results =
+        run_sweep(configs, [](const ExperimentConfig& c, HashFn hash_fn) {
+            return std::make_unique<SimpleDereferenceTable>(
+                c.n, c.q, std::move(hash_fn));
+        });
+
+    ASSERT_EQ(results.size(), configs.size());
+
+    for (const ExperimentResult& result : results) {
+        EXPECT_GE(result.n_slots, result.config.n);
+        EXPECT_GT(result.tiny_pointer_bits, 0u);
+        EXPECT_FALSE(result.delta.has_value());
+        EXPECT_EQ(result.footprint.storage_bytes, result.n_slots * 8);
+        EXPECT_GT(result.footprint.live_entries, result.capacity);
+        ASSERT_EQ(result.load_factors.size(), result.config.trials);
+        EXPECT_TRUE(std::is_sorted(result.load_factors.begin(),
+                                   result.load_factors.end()));
+
+        // Same expectations as the SimpleDereferenceTable_LoadFactor test.
+        //
+        const double p50 = result.load_factor_quantile(0.5);
+        EXPECT_LT(p50, 1.0);
+        EXPECT_GT(p50 * (double)result.n_slots, (double)result.capacity);
+        EXPECT_LE(result.failure_probability, 0.5);
+    }
+
+    std::ostringstream oss;
+    write_csv(oss, results);
+
+    const std::string csv = std::move(oss).str();
+    std::cerr << csv;
+
+    EXPECT_EQ(std::count(csv.begin(), csv.end(), '\n'),
+              1 + (long)results.size());
+}
+
+//==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+//
+TEST(ExperimentTest, FunnelDereferenceTableSweep)
+{
+    const std::vector<ExperimentConfig> configs =
+        make_sweep({SlotCount{1 << 16}, SlotCount{1 << 18}}, {BitsPerSlot{64}},
+                   {Delta{1.0 / 8}, Delta{1.0 / 64}}, /*trials=*/8);
+
+    ASSERT_EQ(configs.size(), 4u);
+
+    const std::vector<ExperimentResult> results =
+        run_sweep(configs, make_funnel_table);
+
+    std::ostringstream csv;
+    write_csv(csv, results);
+    std::cerr << csv.str();
+
+    for (const ExperimentResult& result : results) {
+        ASSERT_EQ(result.load_factors.size(), result.config.trials);
+        ASSERT_TRUE(result.delta.has_value());
+        EXPECT_EQ(*result.delta, result.config.delta);
+        EXPECT_EQ(result.failure_probability, 0.0);
+        EXPECT_GT(result.load_factors.front() * (double)result.n_slots,
+                  (double)result.capacity);
+    }
+
+    // Smaller δ means more of the table is usable, for longer tiny pointers.
+    //
+    EXPECT_GT(results[1].mean_load_factor(), results[0].mean_load_factor());
+    EXPECT_GT(results[1].tiny_pointer_bits, results[0].tiny_pointer_bits);
+}
+
+//==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+//
+TEST(ExperimentTest, Reproducible)
+{
+    const std::vector<ExperimentConfig> configs = make_sweep(
+        {SlotCount{1 << 14}}, {BitsPerSlot{64}}, {Delta{1.0 / 16}},
+        /*trials=*/4);
+
+    // The same seed gives the same results on any number of threads; a
+    // different seed, different tables.
+    //
+    const std::vector<ExperimentResult> a =
+        run_sweep(configs, make_funnel_table, /*n_threads=*/1, /*seed=*/7);
+    const std::vector<ExperimentResult> b =
+        run_sweep(configs, make_funnel_table, /*n_threads=*/3, /*seed=*/7);
+    const std::vector<ExperimentResult> c =
+        run_sweep(configs, make_funnel_table, /*n_threads=*/1, /*seed=*/8);
+
+    std::ostringstream csv_a, csv_b;
+    write_csv(csv_a, a);
+    write_csv(csv_b, b);
+
+    EXPECT_EQ(a[0].load_factors, b[0].load_factors);
+    EXPECT_EQ(csv_a.str(), csv_b.str());
+    EXPECT_NE(a[0].load_factors, c[0].load_factors);
+}
+
+}  // namespace
@@ -0,0 +1,778 @@
+#pragma once
+
+#include "bit_vec.hpp"
+#include "check_policy.hpp"
+#include "imports.hpp"
+#include "tiny_pointers.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <random>
+#include <vector>
+
+namespace tiny_pointers {
+
+//=#=#==#==#===============+=+=+=+=++=++++++++++++++-++-+--+-+----+---------------
+
+/** \brief Funnel hashing, from "Optimal Bounds for Open Addressing Without
+ * Reordering" (Farach-Colton, Krapivin, Kuszmaul), Section 3.
+ *
+ * The store is split into levels A_1, ..., A_α whose sizes shrink
+ * geometrically (|A_i+1| ≈ 3/4 |A_i|), each partitioned into buckets of β =
+ * O(log δ⁻¹) slots, followed by a special array A_α+1 of ~δn/2 slots. Key `x`
+ * is tried in one hashed bucket per level, in order; keys that overflow every
+ * level go to the special array, half of which is a two-choice table with
+ * buckets of 2 log log `n` slots and half of which is probed uniformly at
+ * random (log log `n` probes).
+ *
+ * The tiny pointer for `x` records the level that holds `x` and the position
+ * (slot, choice, or probe number) within that level, so it is O(log log δ⁻¹ +
+ * log log log `n`) bits. The table:
+ *
+ *  1. supports load factor 1 − `d`
+ *  2. has worst-case expected probe complexity O(log² δ⁻¹) for Allocate
+ *  3. has constant-time Dereference and Free
+ *
+ * `CheckPolicy` selects which hot-path assertions are compiled in (see
+ * check_policy.hpp).
+ */
+template <typename CheckPolicy = DefaultCheckPolicy>
+class BasicFunnelDereferenceTable : public DereferenceTable
+{
+   public:
+    /** \brief A contiguous run of equal-sized buckets in the store.
+     */
+    struct Level {
+        usize first_slot;
+        usize first_bucket;
+        usize bucket_count;
+        usize bucket_size;
+
+        // Maps a hash to a bucket within this level.
+        //
+        BucketReducer reduce_bucket;
+    };
+
+    //+++++++++++-+-+--+----- --- -- -  -  -   -
+
+    /** \brief The geometry of a table created with `n` slots and a given δ
+     * (see layout_for).
+     */
+    struct Layout {
+        // log(1/δ), rounded up to a whole number of bits.
+        //
+        i32 log_inv_delta;
+
+        // α, β, and the parameters of the special array.
+        //
+        usize level_count;
+        usize bucket_size;
+        usize probe_count;
+        usize choice_bucket_size;
+        usize choice_bucket_count;
+        usize probe_slot_count;
+
+        // The number of buckets in each of A_1, ..., A_α.
+        //
+        std::vector<usize> level_buckets;
+
+        // The total number of slots in the store; at least `n`.
+        //
+        usize n_slots;
+    };
+
+    /** \brief Returns the layout of a table created with `n` slots and fraction
+     * `d` unallocatable, without allocating the table.
+     */
+    static Layout layout_for(SlotCount n, Delta d) noexcept
+    {
+        BATT_CHECK_GT(d, 0.0);
+        BATT_CHECK_LT(d, 1.0);
+
+        Layout layout;
+
+        // δ is rounded so that log(1/δ) is a whole number of bits.
+        //
+        layout.log_inv_delta = log_inv_delta_for(d);
+
+        // The paper's parameters: α = ⌈4 log δ⁻¹ + 10⌉, β = ⌈2 log δ⁻¹⌉.
+        //
+        layout.level_count = 4 * layout.log_inv_delta + 10;
+        layout.bucket_size = 2 * layout.log_inv_delta;
+
+        // The special array is parameterized by log log n.
+        //
+        layout.probe_count = std::max<i32>(1, log2_ceil(log2_ceil(n)));
+        layout.choice_bucket_size =
+            std::min<usize>(64, 2 * layout.probe_count);
+
+        // Size the special array (A_α+1) in the middle of [δn/2, 3δn/4]; it is
+        // split evenly between the two-choice half and the uniform probing
+        // half.
+        //
+        const usize special_slots = std::max<usize>(
+            4 * layout.choice_bucket_size, (usize)(d * (double)n * 5.0 / 8.0));
+
+        layout.choice_bucket_count = std::max<usize>(
+            2, (special_slots / 2) / layout.choice_bucket_size);
+
+        layout.probe_slot_count = std::max<usize>(
+            layout.probe_count,
+            special_slots -
+                layout.choice_bucket_count * layout.choice_bucket_size);
+
+        // Split the rest of the store into α levels whose sizes decrease by a
+        // factor of 3/4 each; every level gets at least one bucket.
+        //
+        const usize funnel_slots = (n > special_slots) ? (n - special_slots) : 0;
+        const usize funnel_buckets =
+            (funnel_slots + layout.bucket_size - 1) / layout.bucket_size;
+
+        double total_weight = 0;
+        for (usize i = 0; i < layout.level_count; ++i) {
+            total_weight += std::pow(0.75, i);
+        }
+
+        layout.level_buckets.resize(layout.level_count);
+        usize assigned_buckets = 0;
+        for (usize i = 0; i < layout.level_count; ++i) {
+            layout.level_buckets[i] = std::max<usize>(
+                1, (usize)((double)funnel_buckets * std::pow(0.75, i) /
+                           total_weight));
+            assigned_buckets += layout.level_buckets[i];
+        }
+        if (assigned_buckets < funnel_buckets) {
+            layout.level_buckets[0] += funnel_buckets - assigned_buckets;
+            assigned_buckets = funnel_buckets;
+        }
+
+        layout.n_slots = assigned_buckets * layout.bucket_size +
+                         layout.choice_bucket_count *
+                             layout.choice_bucket_size +
+                         layout.probe_slot_count;
+
+        return layout;
+    }
+
+    /** \brief The number of slots of a table created with `n` slots and
+     * fraction `d` unallocatable.
+     */
+    static usize n_slots_for(SlotCount n, Delta d) noexcept
+    {
+        return layout_for(n, d).n_slots;
+    }
+
+    //+++++++++++-+-+--+----- --- -- -  -  -   -
+
+    /** \brief Creates a table with (at least) `n` slots of `q` bits each, of
+     * which a fraction 1 - `d` can be allocated. Keys are hashed with
+     * `hash_fn`; pass a fixed seed (or family) for reproducible placement.
+     */
+    BasicFunnelDereferenceTable(SlotCount n, BitsPerSlot q, Delta d,
+                                HashFn hash_fn = HashFn::random()) noexcept
+        : BasicFunnelDereferenceTable{layout_for(n, d), n, q, d,
+                                      std::move(hash_fn)}
+    {
+    }
+
+    /** \brief Returns the maximum fraction of storage slots available for
+     * allocation.
+     */
+    double load_factor() const noexcept
+    {
+        return 1.0 - this->delta();
+    }
+
+    /** \brief δ - the fraction of slots that may stay unallocated.
+     */
+    double delta() const noexcept
+    {
+        return this->delta_;
+    }
+
+    /** \brief The number of slots in the storage array; not all are available
+     * for allocation (see capacity).
+     */
+    usize n_slots() const noexcept
+    {
+        return this->n_slots_;
+    }
+
+    /** \brief The maximum number of active allocations (w.h.p.).
+     */
+    usize capacity() const noexcept
+    {
+        return this->load_factor() * this->n_slots_;
+    }
+
+    /** \brief The current number of active allocations.
+     */
+    usize size() const noexcept
+    {
+        return this->size_;
+    }
+
+    /** \brief The size of TinyPointers returned by this.
+     */
+    usize tiny_pointer_size() const noexcept
+    {
+        return this->p_bits_;
+    }
+
+    /** \brief The hash function applied to keys.
+     */
+    const HashFn& hash_fn() const noexcept
+    {
+        return this->hash_fn_;
+    }
+
+    /** \brief α - the number of funnel levels (not counting the special
+     * array).
+     */
+    usize level_count() const noexcept
+    {
+        return this->level_count_;
+    }
+
+    /** \brief β - the number of slots per bucket in the funnel levels.
+     */
+    usize bucket_size() const noexcept
+    {
+        return this->bucket_size_;
+    }
+
+    /** \brief The bucket layout of funnel level `i`; level `level_count()` is
+     * the two-choice half of the special array.
+     */
+    const Level& level(usize i) const noexcept
+    {
+        return this->levels_[i];
+    }
+
+    /** \brief The number of slots in the uniform probing half of the special
+     * array.
+     */
+    usize probe_slot_count() const noexcept
+    {
+        return this->probe_slot_count_;
+    }
+
+    /** \brief Invokes `fn(SlotIndex)` for each allocated slot, in increasing
+     * slot order.
+     */
+    template <typename Fn>
+    void for_each_allocated(Fn&& fn) const
+    {
+        for (const Level& level : this->levels_) {
+            for (usize i = 0; i < level.bucket_count; ++i) {
+                u64 used = this->bucket_bits_[level.first_bucket + i];
+                while (used) {
+                    fn(SlotIndex{level.first_slot + i * level.bucket_size +
+                                 __builtin_ctzll(used)});
+                    used &= used - 1;
+                }
+            }
+        }
+        for (usize word_i = 0; word_i < this->probe_bits_.size(); ++word_i) {
+            u64 used = this->probe_bits_[word_i];
+            while (used) {
+                fn(SlotIndex{this->probe_first_slot_ + word_i * 64 +
+                             __builtin_ctzll(used)});
+                used &= used - 1;
+            }
+        }
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    //
+    StatusOr<TinyPointer> Allocate(Key x) noexcept override
+    {
+        return this->allocate_for_hash(this->hash_fn_(x));
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    //
+    SlotIndex Dereference(Key x, TinyPointer p) noexcept override
+    {
+        return this->dereference_for_hash(this->hash_fn_(x), p);
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    //
+    void Free(Key x, TinyPointer p) noexcept override
+    {
+        this->free_for_hash(this->hash_fn_(x), p);
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    // Locality hints: the whole probe sequence is derived from the hint, so
+    // keys sharing a hint fill the same level-1 bucket (β adjacent slots)
+    // before spilling into the same bucket of the next level, and so on.
+
+    StatusOr<TinyPointer> Allocate(Key x, LocalityHint hint) noexcept override
+    {
+        (void)x;
+        return this->allocate_for_hash(hint);
+    }
+
+    SlotIndex Dereference(Key x, LocalityHint hint,
+                          TinyPointer p) noexcept override
+    {
+        (void)x;
+        return this->dereference_for_hash(hint, p);
+    }
+
+    void Free(Key x, LocalityHint hint, TinyPointer p) noexcept override
+    {
+        (void)x;
+        this->free_for_hash(hint, p);
+    }
+
+    /** \brief Returns a hint that places keys near `parent`.
+     */
+    LocalityHint locality_hint(const Key& parent) const noexcept
+    {
+        return LocalityHint{this->hash_fn_(parent)};
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    /** \brief Allocates a slot for a key whose hash is `h`.
+     */
+    StatusOr<TinyPointer> allocate_for_hash(u64 h) noexcept
+    {
+        // Try one bucket in each funnel level, in order.
+        //
+        for (usize level_i = 0; level_i < this->level_count_; ++level_i) {
+            const usize bucket_i = this->find_bucket(h, level_i, 0);
+            const u64 used = this->bucket_bits_[bucket_i];
+            if (used != low_bits_mask(this->bucket_size_)) {
+                const usize slot_i = __builtin_ctzll(~used);
+                this->bucket_bits_[bucket_i] |= u64{1} << slot_i;
+                ++this->size_;
+                return this->make_pointer(level_i, slot_i);
+            }
+        }
+
+        // Every level was full; fall back to the special array, first using
+        // uniform probing...
+        //
+        for (usize probe_i = 0; probe_i < this->probe_count_; ++probe_i) {
+            const usize slot_i = this->find_probe_slot(h, probe_i);
+            u64& used = this->probe_bits_[slot_i / 64];
+            const u64 mask = u64{1} << (slot_i % 64);
+            if ((used & mask) == 0) {
+                used |= mask;
+                ++this->size_;
+                return this->make_pointer(this->level_count_ + 1, probe_i);
+            }
+        }
+
+        // ...then picking the less loaded of two buckets.
+        //
+        const usize bucket_0 = this->find_bucket(h, this->level_count_, 0);
+        const usize bucket_1 = this->find_bucket(h, this->level_count_, 1);
+
+        const usize choice_i =
+            (__builtin_popcountll(this->bucket_bits_[bucket_1]) <
+             __builtin_popcountll(this->bucket_bits_[bucket_0]))
+                ? 1
+                : 0;
+        const usize bucket_i = choice_i ? bucket_1 : bucket_0;
+        const u64 used = this->bucket_bits_[bucket_i];
+
+        if (used == low_bits_mask(this->choice_bucket_size_)) {
+            return {batt::StatusCode::kResourceExhausted};
+        }
+
+        const usize slot_i = __builtin_ctzll(~used);
+        this->bucket_bits_[bucket_i] |= u64{1} << slot_i;
+        ++this->size_;
+        return this->make_pointer(this->level_count_,
+                                  choice_i * this->choice_bucket_size_ + slot_i);
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    /** \brief Returns the slot referred to by `p` for a key whose hash is `h`.
+     */
+    SlotIndex dereference_for_hash(u64 h, const TinyPointer& p) const noexcept
+    {
+        TINY_POINTERS_CHECK_EQ(CheckPolicy, p.size(), this->p_bits_);
+
+        const usize level_i = p.int_value() >> this->slot_bits_;
+        const usize pos = p.int_value() & low_bits_mask(this->slot_bits_);
+
+        if (level_i == this->level_count_ + 1) {
+            return SlotIndex{this->probe_first_slot_ +
+                             this->find_probe_slot(h, pos)};
+        }
+        TINY_POINTERS_CHECK_LE(CheckPolicy, level_i, this->level_count_);
+
+        const usize bucket_i = this->find_bucket_for(h, level_i, pos);
+        const Level& level = this->levels_[level_i];
+
+        return SlotIndex{
+            level.first_slot +
+            (bucket_i - level.first_bucket) * level.bucket_size +
+            pos % level.bucket_size};
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    /** \brief Frees the slot referred to by `p` for a key whose hash is `h`.
+     */
+    void free_for_hash(u64 h, const TinyPointer& p) noexcept
+    {
+        TINY_POINTERS_CHECK_EQ(CheckPolicy, p.size(), this->p_bits_);
+
+        const usize level_i = p.int_value() >> this->slot_bits_;
+        const usize pos = p.int_value() & low_bits_mask(this->slot_bits_);
+
+        if (level_i == this->level_count_ + 1) {
+            const usize slot_i = this->find_probe_slot(h, pos);
+            this->probe_bits_[slot_i / 64] &= ~(u64{1} << (slot_i % 64));
+        } else {
+            TINY_POINTERS_CHECK_LE(CheckPolicy, level_i, this->level_count_);
+
+            const usize bucket_i = this->find_bucket_for(h, level_i, pos);
+            const usize slot_i = pos % this->levels_[level_i].bucket_size;
+            this->bucket_bits_[bucket_i] &= ~(u64{1} << slot_i);
+        }
+
+        --this->size_;
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    //
+    void Set(SlotIndex i, Value v) noexcept override
+    {
+        TINY_POINTERS_CHECK_LE(CheckPolicy, v.size(), this->q_bits_per_slot_);
+
+        const usize pos = i * this->q_bits_per_slot_;
+
+        this->storage_.set_range(pos, v);
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    //
+    Value Get(SlotIndex i) noexcept override
+    {
+        const usize pos = i * this->q_bits_per_slot_;
+
+        return this->storage_.get_range(pos, pos + this->q_bits_per_slot_);
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    //
+    void Clear() noexcept override
+    {
+        // Occupancy is one word per bucket (plus the probing array's bitmap),
+        // so this is O(buckets).
+        //
+        std::fill(this->bucket_bits_.begin(), this->bucket_bits_.end(), 0);
+        std::fill(this->probe_bits_.begin(), this->probe_bits_.end(), 0);
+        this->size_ = 0;
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    //
+    MemoryFootprint footprint() const noexcept override
+    {
+        return MemoryFootprint{
+            .storage_bytes = this->storage_.byte_size(),
+            .metadata_bytes = sizeof(*this) +
+                              this->levels_.capacity() * sizeof(Level) +
+                              this->bucket_bits_.capacity() * sizeof(u64) +
+                              this->probe_bits_.capacity() * sizeof(u64),
+            .live_entries = this->size_,
+            .tiny_pointer_bits = (usize)this->p_bits_,
+        };
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    /** \brief Writes a snapshot of this table (header, then occupancy words,
+     * then the store) to `out`.
+     */
+    Status save(std::ostream& out) const
+    {
+        BATT_REQUIRE_OK(write_snapshot_header(
+            out, SnapshotHeader{
+                     .layout = SnapshotLayout::kFunnel,
+                     .hash_family = this->hash_fn_.family(),
+                     .n = this->requested_n_slots_,
+                     .q = this->q_bits_per_slot_,
+                     .p_bits = (u64)this->p_bits_,
+                     .seed = this->hash_fn_.seed(),
+                     .delta = this->delta_,
+                     .size = this->size_,
+                 }));
+
+        BATT_REQUIRE_OK(write_words(out, this->bucket_bits_));
+        BATT_REQUIRE_OK(write_words(out, this->probe_bits_));
+
+        return write_bit_vec(out, this->storage_);
+    }
+
+    /** \brief Reads a table written by save; tiny pointers returned by the
+     * saved table are valid for the loaded one. If the table used a custom hash
+     * function, the same function must be passed as `custom_fn`.
+     */
+    static StatusOr<std::unique_ptr<BasicFunnelDereferenceTable>> load(
+        std::istream& in, const HashFn::CustomFn& custom_fn = nullptr)
+    {
+        BATT_ASSIGN_OK_RESULT(
+            const SnapshotHeader header,
+            read_snapshot_header(in, SnapshotLayout::kFunnel));
+
+        // Validate the geometry the constructor would derive from the header
+        // before constructing anything (the constructor panics on bad input).
+        // Every level gets at least one bucket, and the special array has a
+        // minimum size, so the store can be much bigger than n when n is
+        // small; check the real slot count.
+        //
+        if (!(header.delta > 0.0 && header.delta < 1.0) ||
+            1.0 / header.delta > kMaxFunnelInvDelta ||
+            2 * log_inv_delta_for(Delta{header.delta}) > 64 ||
+            header.n < 2 || header.n > kMaxSnapshotSlots) {
+            return {batt::StatusCode::kDataLoss};
+        }
+
+        const Layout layout =
+            layout_for(SlotCount{header.n}, Delta{header.delta});
+        if (!snapshot_geometry_ok(header.n, layout.n_slots, header.q)) {
+            return {batt::StatusCode::kDataLoss};
+        }
+
+        BATT_ASSIGN_OK_RESULT(
+            HashFn hash_fn,
+            HashFn::restore(header.hash_family, header.seed, custom_fn));
+
+        std::unique_ptr<BasicFunnelDereferenceTable> table{
+            new BasicFunnelDereferenceTable{layout, SlotCount{header.n},
+                                            BitsPerSlot{header.q},
+                                            Delta{header.delta},
+                                            std::move(hash_fn)}};
+
+        if ((u64)table->p_bits_ != header.p_bits ||
+            header.size > table->n_slots_) {
+            return {batt::StatusCode::kDataLoss};
+        }
+
+        table->size_ = header.size;
+
+        BATT_REQUIRE_OK(read_words(in, table->bucket_bits_));
+        BATT_REQUIRE_OK(read_words(in, table->probe_bits_));
+        BATT_REQUIRE_OK(read_bit_vec(in, table->storage_));
+
+        // The occupancy bits must agree with the header.
+        //
+        usize live = 0;
+        for (u64 word : table->bucket_bits_) {
+            live += __builtin_popcountll(word);
+        }
+        for (u64 word : table->probe_bits_) {
+            live += __builtin_popcountll(word);
+        }
+        if (live != table->size_) {
+            return {batt::StatusCode::kDataLoss};
+        }
+
+        return table;
+    }
+
+   private:
+    /** \brief Creates a table with the given `layout` (from layout_for(n,
+     * d)).
+     */
+    BasicFunnelDereferenceTable(const Layout& layout, SlotCount n,
+                                BitsPerSlot q, Delta d, HashFn hash_fn) noexcept
+        : log_inv_delta_(layout.log_inv_delta)
+        , delta_{d}
+        , level_count_(layout.level_count)
+        , bucket_size_(layout.bucket_size)
+        , probe_count_(layout.probe_count)
+        , choice_bucket_size_{layout.choice_bucket_size}
+        , q_bits_per_slot_{q}
+        , requested_n_slots_{n}
+        , probe_slot_count_{layout.probe_slot_count}
+        , size_{0}
+        , hash_fn_{std::move(hash_fn)}
+    {
+        BATT_CHECK_LE(this->bucket_size_, 64);
+
+        // Lay out the levels in the store: A_1, ..., A_α, then the two-choice
+        // array, then the uniform probing array.
+        //
+        usize next_slot = 0;
+        usize next_bucket = 0;
+        for (usize i = 0; i <= this->level_count_; ++i) {
+            const usize bucket_count = (i < this->level_count_)
+                                           ? layout.level_buckets[i]
+                                           : layout.choice_bucket_count;
+            const usize bucket_size = (i < this->level_count_)
+                                          ? this->bucket_size_
+                                          : this->choice_bucket_size_;
+            this->levels_.push_back(Level{
+                .first_slot = next_slot,
+                .first_bucket = next_bucket,
+                .bucket_count = bucket_count,
+                .bucket_size = bucket_size,
+                .reduce_bucket = BucketReducer{bucket_count},
+            });
+            next_slot += bucket_count * bucket_size;
+            next_bucket += bucket_count;
+        }
+        this->probe_first_slot_ = next_slot;
+        this->n_slots_ = next_slot + this->probe_slot_count_;
+        this->reduce_probe_slot_ = BucketReducer{this->probe_slot_count_};
+
+        // The tiny pointer is (level, position); the position is a slot within
+        // a bucket, (choice, slot) within the two-choice array, or a probe
+        // number within the uniform probing array.
+        //
+        this->level_bits_ = log2_ceil(this->level_count_ + 2);
+        this->slot_bits_ = log2_ceil(std::max<usize>(
+            {this->bucket_size_, 2 * this->choice_bucket_size_,
+             this->probe_count_}));
+        this->p_bits_ = this->level_bits_ + this->slot_bits_;
+
+        this->bucket_bits_.resize(next_bucket, 0);
+        this->probe_bits_.resize((this->probe_slot_count_ + 63) / 64, 0);
+        this->storage_ = BitVec{this->n_slots_ * this->q_bits_per_slot_};
+
+        BATT_CHECK_EQ(this->n_slots_, layout.n_slots);
+        BATT_CHECK_GE(this->n_slots_, n);
+    }
+
+    //+++++++++++-+-+--+----- --- -- -  -  -   -
+
+    // The largest 1/δ a snapshot may hold; the constructor requires β = 2 log
+    // δ⁻¹ <= 64.
+    //
+    static constexpr double kMaxFunnelInvDelta = 4294967296.0;  // 2^32
+
+    /** \brief log(1/δ), rounded up to a whole number of bits (at least 1).
+     */
+    static i32 log_inv_delta_for(Delta d) noexcept
+    {
+        return std::max<i32>(1, log2_ceil(std::ceil(1.0 / d)));
+    }
+
+    /** \brief Derives the hash used to pick a location at step `i` of the
+     * probe sequence for a key whose hash is `h`.
+     */
+    static u64 step_hash(u64 h, usize i) noexcept
+    {
+        return mix_u64(h + i * 0x9e3779b97f4a7c15ull);
+    }
+
+    /** \brief Returns the global index of the `choice_i`-th candidate bucket
+     * in level `level_i`; only the two-choice level has more than one.
+     */
+    usize find_bucket(u64 h, usize level_i, usize choice_i) const noexcept
+    {
+        const Level& level = this->levels_[level_i];
+
+        return level.first_bucket +
+               level.reduce_bucket(step_hash(h, level_i + choice_i));
+    }
+
+    /** \brief Returns the global index of the bucket referred to by position
+     * `pos` in level `level_i`.
+     */
+    usize find_bucket_for(u64 h, usize level_i, usize pos) const noexcept
+    {
+        if (level_i < this->level_count_) {
+            return this->find_bucket(h, level_i, 0);
+        }
+        return this->find_bucket(h, level_i, pos / this->choice_bucket_size_);
+    }
+
+    /** \brief Returns the index (relative to the start of the uniform probing
+     * array) of the `probe_i`-th probe location.
+     */
+    usize find_probe_slot(u64 h, usize probe_i) const noexcept
+    {
+        return this->reduce_probe_slot_(
+            step_hash(h, this->level_count_ + 2 + probe_i));
+    }
+
+    TinyPointer make_pointer(usize level_i, usize pos) const noexcept
+    {
+        return TinyPointer{this->p_bits_, (level_i << this->slot_bits_) | pos};
+    }
+
+    //+++++++++++-+-+--+----- --- -- -  -  -   -
+
+    // log(1/δ)
+    //
+    const i32 log_inv_delta_;
+
+    // 1 - load_factor
+    //
+    const Delta delta_;
+
+    // α - the number of funnel levels
+    //
+    const usize level_count_;
+
+    // β - the funnel bucket size
+    //
+    const usize bucket_size_;
+
+    // The number of probes in the uniform probing array (log log n).
+    //
+    const usize probe_count_;
+
+    // The bucket size of the two-choice array (2 log log n).
+    //
+    const usize choice_bucket_size_;
+
+    // q - the value size
+    //
+    const BitsPerSlot q_bits_per_slot_;
+
+    // n, as passed to the constructor; recorded in snapshots.
+    //
+    const SlotCount requested_n_slots_;
+
+    // A_1, ..., A_α, then the two-choice array.
+    //
+    std::vector<Level> levels_;
+
+    // The uniform probing array comes last in the store.
+    //
+    usize probe_first_slot_;
+    usize probe_slot_count_;
+    BucketReducer reduce_probe_slot_{1};
+
+    // n - the number of slots
+    //
+    usize n_slots_;
+
+    // The TinyPointer size, in bits: level_bits_ + slot_bits_.
+    //
+    i32 level_bits_;
+    i32 slot_bits_;
+    i32 p_bits_;
+
+    // The number of active allocations.
+    //
+    usize size_;
+    HashFn hash_fn_;
+
+    // One occupancy word per bucket (funnel levels and two-choice array), and
+    // one bit per slot in the uniform probing array.
+    //
+    std::vector<u64> bucket_bits_;
+    std::vector<u64> probe_bits_;
+    BitVec storage_;
+};
+
+/** \brief A FunnelDereferenceTable using the build's DefaultCheckPolicy.
+ */
+using FunnelDereferenceTable = BasicFunnelDereferenceTable<>;
+
+}  //namespace tiny_pointers
@@ -0,0 +1,427 @@
+#include <tiny_pointers/funnel_dereference_table.hpp>
+//
+#include <tiny_pointers/funnel_dereference_table.hpp>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <tiny_pointers/data.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+using namespace batt::int_types;
+using tiny_pointers::BitsPerSlot;
+using tiny_pointers::BitVec;
+using tiny_pointers::Delta;
+using tiny_pointers::DereferenceTable;
+using tiny_pointers::FunnelDereferenceTable;
+using tiny_pointers::HashFamily;
+using tiny_pointers::HashFn;
+using tiny_pointers::kMaxSnapshotSlots;
+using tiny_pointers::LocalityHint;
+using tiny_pointers::MemoryFootprint;
+using tiny_pointers::random_key;
+using tiny_pointers::SimpleDereferenceTable;
+using tiny_pointers::SlotCount;
+using tiny_pointers::SlotIndex;
+using tiny_pointers::StatusOr;
+using tiny_pointers::TinyPointer;
+using tiny_pointers::Value;
+
+//==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+//
+TEST(FunnelDereferenceTableTest, AllocateDereferenceFree)
+{
+    FunnelDereferenceTable fdt{SlotCount{4096}, BitsPerSlot{64}, Delta{1.0 / 16}};
+
+    EXPECT_EQ(fdt.size(), 0);
+    EXPECT_GE(fdt.n_slots(), 4096);
+
+    std::cerr << BATT_INSPECT(fdt.n_slots()) << std::endl
+              << BATT_INSPECT(fdt.capacity()) << std::endl
+              << BATT_INSPECT(fdt.level_count()) << std::endl
+              << BATT_INSPECT(fdt.bucket_size()) << std::endl
+              << BATT_INSPECT(fdt.probe_slot_count()) << std::endl
+              << BATT_INSPECT(fdt.tiny_pointer_size()) << std::endl
+        //
+        ;
+
+    std::vector<std::string> keys;
+    std::vector<TinyPointer> ptrs;
+    std::unordered_set<usize> slots;
+
+    for (usize i = 0; i < fdt.capacity(); ++i) {
+        keys.emplace_back(std::to_string(i));
+
+        StatusOr<TinyPointer> p = fdt.Allocate(keys.back());
+        ASSERT_TRUE(p.ok()) << BATT_INSPECT(i);
+        EXPECT_EQ(p->size(), fdt.tiny_pointer_size());
+
+        const SlotIndex slot = fdt.Dereference(keys.back(), *p);
+        ASSERT_LT(slot, fdt.n_slots());
+        EXPECT_TRUE(slots.insert(slot).second) << BATT_INSPECT(i);
+
+        fdt.Set(slot, Value{64, u64{i}});
+        ptrs.emplace_back(std::move(*p));
+    }
+    EXPECT_EQ(fdt.size(), keys.size());
+
+    for (usize i = 0; i < keys.size(); ++i) {
+        EXPECT_EQ(fdt.Get(fdt.Dereference(keys[i], ptrs[i])).int_value(), i);
+    }
+
+    // Free the even keys, then re-allocate them; the live odd keys must keep
+    // their values.
+    //
+    for (usize i = 0; i < keys.size(); i += 2) {
+        fdt.Free(keys[i], ptrs[i]);
+    }
+    EXPECT_EQ(fdt.size(), keys.size() / 2);
+
+    for (usize i = 0; i < keys.size(); i += 2) {
+        StatusOr<TinyPointer> p = fdt.Allocate(keys[i]);
+        ASSERT_TRUE(p.ok()) << BATT_INSPECT(i);
+        ptrs[i] = std::move(*p);
+        fdt.Set(fdt.Dereference(keys[i], ptrs[i]), Value{64, u64{i}});
+    }
+    for (usize i = 0; i < keys.size(); ++i) {
+        EXPECT_EQ(fdt.Get(fdt.Dereference(keys[i], ptrs[i])).int_value(), i);
+    }
+
+    slots.clear();
+    for (usize i = 0; i < keys.size(); ++i) {
+        slots.insert(fdt.Dereference(keys[i], ptrs[i]));
+    }
+
+    std::unordered_set<usize> live;
+    fdt.for_each_allocated([&live](SlotIndex i) {
+        EXPECT_TRUE(live.insert(i).second);
+    });
+    EXPECT_EQ(live, slots);
+
+    fdt.Clear();
+
+    EXPECT_EQ(fdt.size(), 0);
+    fdt.for_each_allocated([](SlotIndex) {
+        ADD_FAILURE();
+    });
+    for (usize i = 0; i < keys.size(); ++i) {
+        ASSERT_TRUE(fdt.Allocate(keys[i]).ok()) << BATT_INSPECT(i);
+    }
+}
+
+//==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+//
+TEST(FunnelDereferenceTableTest, LocalityHint)
+{
+    FunnelDereferenceTable fdt{SlotCount{4096}, BitsPerSlot{64}, Delta{1.0 / 16}};
+
+    const LocalityHint hint = fdt.locality_hint("parent");
+
+    // Siblings fill the same level-1 bucket, so they are adjacent in the store.
+    //
+    std::vector<std::string> children;
+    std::vector<TinyPointer> ptrs;
+    std::vector<usize> slots;
+    for (usize j = 0; j < fdt.bucket_size(); ++j) {
+        children.emplace_back("parent:" + std::to_string(j));
+
+        StatusOr<TinyPointer> p = fdt.Allocate(children.back(), hint);
+        ASSERT_TRUE(p.ok());
+
+        const SlotIndex slot = fdt.Dereference(children.back(), hint, *p);
+        fdt.Set(slot, Value{64, u64{j}});
+        slots.emplace_back(slot);
+        ptrs.emplace_back(std::move(*p));
+    }
+    std::sort(slots.begin(), slots.end());
+    EXPECT_EQ(slots.back() - slots.front(), fdt.bucket_size() - 1);
+
+    for (usize j = 0; j < children.size(); ++j) {
+        EXPECT_EQ(fdt.Get(fdt.Dereference(children[j], hint, ptrs[j]))
+                      .int_value(),
+                  j);
+        fdt.Free(children[j], hint, ptrs[j]);
+    }
+    EXPECT_EQ(fdt.size(), 0);
+}
+
+//==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+//
+TEST(FunnelDereferenceTableTest, Snapshot)
+{
+    FunnelDereferenceTable fdt{SlotCount{4096}, BitsPerSlot{64}, Delta{1.0 / 16}};
+
+    std::vector<std::string> keys;
+    std::vector<TinyPointer> ptrs;
+    for (usize i = 0; i < fdt.capacity(); ++i) {
+        keys.emplace_back(std::to_string(i));
+        StatusOr<TinyPointer> p = fdt.Allocate(keys.back());
+        ASSERT_TRUE(p.ok());
+        fdt.Set(fdt.Dereference(keys.back(), *p), Value{64, u64{i}});
+        ptrs.emplace_back(std::move(*p));
+    }
+
+    std::stringstream ss;
+    ASSERT_TRUE(fdt.save(ss).ok());
+
+    // A funnel snapshot is not a simple table snapshot.
+    //
+    {
+        std::stringstream ss2{ss.str()};
+        EXPECT_FALSE(SimpleDereferenceTable::load(ss2).ok());
+    }
+
+    StatusOr<std::unique_ptr<FunnelDereferenceTable>> loaded =
+        FunnelDereferenceTable::load(ss);
+    ASSERT_TRUE(loaded.ok());
+
+    FunnelDereferenceTable& copy = **loaded;
+
+    EXPECT_EQ(copy.size(), fdt.size());
+    for (usize i = 0; i < keys.size(); ++i) {
+        EXPECT_EQ(copy.Get(copy.Dereference(keys[i], ptrs[i])).int_value(), i);
+    }
+    for (usize i = 0; i < keys.size(); i += 2) {
+        copy.Free(keys[i], ptrs[i]);
+        fdt.Free(keys[i], ptrs[i]);
+    }
+    for (usize i = 0; i < keys.size(); i += 2) {
+        StatusOr<TinyPointer> p0 = fdt.Allocate(keys[i]);
+        StatusOr<TinyPointer> p1 = copy.Allocate(keys[i]);
+        ASSERT_TRUE(p0.ok());
+        ASSERT_TRUE(p1.ok());
+        EXPECT_EQ(p0->int_value(), p1->int_value());
+    }
+}
+
+//==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+//
+TEST(FunnelDereferenceTableTest, LoadFactor)
+{
+    for (double delta : {1.0 / 8, 1.0 / 64, 1.0 / 256}) {
+        FunnelDereferenceTable fdt{SlotCount{1 << 20}, BitsPerSlot{64},
+                                   Delta{delta}};
+
+        for (usize k = 0; k < fdt.n_slots(); ++k) {
+            if (!fdt.Allocate(std::string_view{(const char*)&k, sizeof(k)})
+                     .ok()) {
+                break;
+            }
+        }
+
+        const double achieved = (double)fdt.size() / (double)fdt.n_slots();
+
+        std::cerr << BATT_INSPECT(delta) << BATT_INSPECT(achieved)
+                  << BATT_INSPECT(fdt.load_factor())
+                  << BATT_INSPECT(fdt.tiny_pointer_size()) << std::endl;
+
+        EXPECT_GT(fdt.size(), fdt.capacity());
+    }
+}
+
+//==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+//
+TEST(FunnelDereferenceTableTest, CorruptSnapshot)
+{
+    FunnelDereferenceTable fdt{SlotCount{4096}, BitsPerSlot{64}, Delta{1.0 / 16}};
+    for (usize i = 0; i < 1000; ++i) {
+        ASSERT_TRUE(fdt.Allocate(std::to_string(i)).ok());
+    }
+
+    std::stringstream ss;
+    ASSERT_TRUE(fdt.save(ss).ok());
+    const std::string snapshot = ss.str();
+
+    // Header fields (after the 8-byte magic, layout/version, and hash family):
+    // n, q, p_bits, seed, delta, size.
+    //
+    const usize kN = 24, kQ = 32, kDelta = 56, kSize = 64;
+
+    const auto load_with = [&](usize offset, u64 value) {
+        std::string corrupt = snapshot;
+        std::memcpy(corrupt.data() + offset, &value, sizeof(value));
+        std::stringstream in{corrupt};
+        return FunnelDereferenceTable::load(in).status();
+    };
+
+    EXPECT_TRUE(load_with(kSize, fdt.size()).ok());
+
+    for (double delta : {1e-12, 0.0, 1.0, -0.5, std::nan("")}) {
+        EXPECT_EQ(load_with(kDelta, std::bit_cast<u64>(delta)),
+                  batt::StatusCode::kDataLoss)
+            << BATT_INSPECT(delta);
+    }
+    EXPECT_EQ(load_with(kN, 0), batt::StatusCode::kDataLoss);
+    EXPECT_EQ(load_with(kN, u64{1} << 50), batt::StatusCode::kDataLoss);
+    EXPECT_EQ(load_with(kQ, 0), batt::StatusCode::kDataLoss);
+    EXPECT_EQ(load_with(kQ, u64{1} << 40), batt::StatusCode::kDataLoss);
+    EXPECT_EQ(load_with(kSize, fdt.n_slots() + 1), batt::StatusCode::kDataLoss);
+    EXPECT_EQ(load_with(kSize, fdt.size() + 1), batt::StatusCode::kDataLoss);
+
+    // With δ = 1/8, n = kMaxSnapshotSlots is within the limits (and n * q is
+    // exactly the store limit), but rounding to whole buckets takes the real
+    // slot count past them; that must be rejected before the store is
+    // allocated.
+    //
+    ASSERT_GT(FunnelDereferenceTable::n_slots_for(SlotCount{kMaxSnapshotSlots},
+                                                  Delta{1.0 / 8}),
+              kMaxSnapshotSlots);
+    {
+        std::string corrupt = snapshot;
+        const u64 n = kMaxSnapshotSlots;
+        const u64 delta = std::bit_cast<u64>(1.0 / 8);
+        std::memcpy(corrupt.data() + kN, &n, sizeof(n));
+        std::memcpy(corrupt.data() + kDelta, &delta, sizeof(delta));
+        std::stringstream in{corrupt};
+
+        EXPECT_EQ(FunnelDereferenceTable::load(in).status(),
+                  batt::StatusCode::kDataLoss);
+    }
+}
+
+//==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+//
+TEST(FunnelDereferenceTableTest, LayoutFor)
+{
+    // Every level has at least one bucket, so for small n and δ the store is
+    // much bigger than n; layout_for must agree with the constructor anyway.
+    //
+    for (u64 n : {2, 100, 4096, 100000}) {
+        for (double delta : {1.0 / 2, 1.0 / 16, 1.0 / (1 << 20)}) {
+            FunnelDereferenceTable fdt{SlotCount{n}, BitsPerSlot{8},
+                                       Delta{delta}};
+            EXPECT_EQ(FunnelDereferenceTable::n_slots_for(SlotCount{n},
+                                                          Delta{delta}),
+                      fdt.n_slots())
+                << BATT_INSPECT(n) << BATT_INSPECT(delta);
+        }
+    }
+
+    EXPECT_GT(FunnelDereferenceTable::n_slots_for(SlotCount{2},
+                                                  Delta{1.0 / (1 << 20)}),
+              1000u);
+}
+
+//==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+//
+TEST(FunnelDereferenceTableTest, Seeded)
+{
+    const HashFn hash_fn{HashFamily::kMultiplyMix, 7};
+
+    FunnelDereferenceTable fdt0{SlotCount{4096}, BitsPerSlot{64},
+                                Delta{1.0 / 16}, hash_fn};
+    FunnelDereferenceTable fdt1{SlotCount{4096}, BitsPerSlot{64},
+                                Delta{1.0 / 16}, hash_fn};
+
+    for (usize i = 0; i < fdt0.capacity(); ++i) {
+        const std::string key = std::to_string(i);
+        StatusOr<TinyPointer> p0 = fdt0.Allocate(key);
+        StatusOr<TinyPointer> p1 = fdt1.Allocate(key);
+        ASSERT_TRUE(p0.ok());
+        ASSERT_TRUE(p1.ok());
+        EXPECT_EQ(p0->int_value(), p1->int_value());
+    }
+
+    std::stringstream ss;
+    ASSERT_TRUE(fdt0.save(ss).ok());
+
+    StatusOr<std::unique_ptr<FunnelDereferenceTable>> loaded =
+        FunnelDereferenceTable::load(ss);
+    ASSERT_TRUE(loaded.ok());
+    EXPECT_EQ((*loaded)->hash_fn().family(), HashFamily::kMultiplyMix);
+    EXPECT_EQ((*loaded)->hash_fn().seed(), 7u);
+}
+
+//==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+//
+template <typename TableT>
+void run_benchmark(const char* name, TableT& table,
+                   const std::vector<std::string>& keys)
+{
+    using Clock = std::chrono::steady_clock;
+
+    const usize n_keys = std::min<usize>(keys.size(), table.capacity());
+    std::vector<TinyPointer> ptrs;
+    ptrs.reserve(n_keys);
+
+    const auto t0 = Clock::now();
+    for (usize i = 0; i < n_keys; ++i) {
+        StatusOr<TinyPointer> p = table.Allocate(keys[i]);
+        BATT_CHECK(p.ok());
+        ptrs.emplace_back(std::move(*p));
+    }
+    const auto t1 = Clock::now();
+
+    // Give every entry a known value (untimed), so that the dereference loop
+    // reads real data and its checksum verifies each lookup.
+    //
+    for (usize i = 0; i < n_keys; ++i) {
+        table.Set(table.Dereference(keys[i], ptrs[i]), BitVec{64, i + 1});
+    }
+    const u64 expected_checksum = u64{n_keys} * (n_keys + 1) / 2;
+
+    const auto t2 = Clock::now();
+    u64 checksum = 0;
+    for (usize i = 0; i < n_keys; ++i) {
+        checksum += table.Get(table.Dereference(keys[i], ptrs[i])).int_value();
+    }
+    const auto t3 = Clock::now();
+
+    EXPECT_EQ(checksum, expected_checksum) << BATT_INSPECT(name);
+
+    const auto ns_per_op = [n_keys](auto d) {
+        return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(d)
+                   .count() /
+               (double)n_keys;
+    };
+
+    // Memory vs. throughput: report the footprint at the load the timings
+    // were taken at.
+    //
+    const MemoryFootprint footprint = table.footprint();
+
+    std::cerr << name << ":" << BATT_INSPECT(n_keys)
+              << BATT_INSPECT(table.n_slots())
+              << BATT_INSPECT(table.tiny_pointer_size())
+              << BATT_INSPECT(ns_per_op(t1 - t0))
+              << BATT_INSPECT(ns_per_op(t3 - t2)) << BATT_INSPECT(checksum)
+              << BATT_INSPECT(footprint.storage_bytes)
+              << BATT_INSPECT(footprint.metadata_bytes)
+              << BATT_INSPECT(footprint.bytes_per_live_entry())
+              << BATT_INSPECT(footprint.net_bytes_saved()) << std::endl;
+}
+
+TEST(FunnelDereferenceTableTest, Benchmark)
+{
+    std::default_random_engine rng{std::random_device{}()};
+
+    const usize n = 1 << 21;
+    std::vector<std::string> keys;
+    for (usize i = 0; i < n; ++i) {
+        keys.emplace_back(random_key(rng));
+    }
+
+    {
+        SimpleDereferenceTable sdt{SlotCount{n}, BitsPerSlot{64}};
+        run_benchmark("SimpleDereferenceTable", sdt, keys);
+    }
+    {
+        FunnelDereferenceTable fdt{SlotCount{n}, BitsPerSlot{64},
+                                   Delta{1.0 / 64}};
+        run_benchmark("FunnelDereferenceTable", fdt, keys);
+    }
+}
+
+}  // namespace
@@ -0,0 +1,376 @@
+#pragma once
+
+#include "imports.hpp"
+#include "util.hpp"
+
+// For XXH3_64bits_withSecretandSeed and XXH3_generateSecret_fromSeed.
+//
+#ifndef XXH_STATIC_LINKING_ONLY
+#define XXH_STATIC_LINKING_ONLY
+#endif
+#include <xxhash.h>
+
+#include <array>
+#include <bit>
+#include <functional>
+#include <random>
+#include <string_view>
+#include <utility>
+
+namespace tiny_pointers {
+
+//=#=#==#==#===============+=+=+=+=++=++++++++++++++-++-+--+-+----+---------------
+
+/** \brief The hash function families HashFn can use; the same values
+ * identify them in snapshots.
+ */
+enum struct HashFamily : u32 {
+    kXXH3 = 1,
+
+    // A wyhash-style multiply-mix (see multiply_mix_hash).
+    //
+    kMultiplyMix = 2,
+
+    // A function supplied by the caller, who must supply it again to load a
+    // snapshot.
+    //
+    kCustom = 3,
+};
+
+namespace detail {
+
+// The parts of XXH3 (xxhash.h, v0.8) needed to hash keys of up to
+// kXXH3InlineMaxLen bytes inline; longer keys go through the library.
+//
+constexpr usize kXXH3InlineMaxLen = 128;
+
+constexpr u64 kXXH64Prime1 = 0x9E3779B185EBCA87ull;
+constexpr u64 kXXH64Prime2 = 0xC2B2AE3D27D4EB4Full;
+constexpr u64 kXXH64Prime3 = 0x165667B19E3779F9ull;
+constexpr u64 kXXH3PrimeMx1 = 0x165667919E3779F9ull;
+constexpr u64 kXXH3PrimeMx2 = 0x9FB21C651E98DF25ull;
+
+inline u64 xxh64_avalanche(u64 h) noexcept
+{
+    h ^= h >> 33;
+    h *= kXXH64Prime2;
+    h ^= h >> 29;
+    h *= kXXH64Prime3;
+    h ^= h >> 32;
+    return h;
+}
+
+inline u64 xxh3_avalanche(u64 h) noexcept
+{
+    h ^= h >> 37;
+    h *= kXXH3PrimeMx1;
+    h ^= h >> 32;
+    return h;
+}
+
+inline u64 xxh3_rrmxmx(u64 h, u64 len) noexcept
+{
+    h ^= std::rotl(h, 49) ^ std::rotl(h, 24);
+    h *= kXXH3PrimeMx2;
+    h ^= (h >> 35) + len;
+    h *= kXXH3PrimeMx2;
+    h ^= h >> 28;
+    return h;
+}
+
+/** \brief XXH3's default secret (the secret it derives from seed 0).
+ */
+inline const std::array<u8, XXH3_SECRET_DEFAULT_SIZE>& xxh3_default_secret()
+{
+    static const std::array<u8, XXH3_SECRET_DEFAULT_SIZE> secret = [] {
+        std::array<u8, XXH3_SECRET_DEFAULT_SIZE> secret;
+        XXH3_generateSecret_fromSeed(secret.data(), 0);
+        return secret;
+    }();
+
+    return secret;
+}
+
+}  //namespace detail
+
+//=#=#==#==#===============+=+=+=+=++=++++++++++++++-++-+--+-+----+---------------
+
+/** \brief Define a family of seed-able hash functions for the various
+ * constructions.
+ *
+ * A HashFn is fully determined by its family and seed (plus the function, for
+ * HashFamily::kCustom), so two tables built with equal HashFns and fed the
+ * same operations make the same decisions, on any host.
+ */
+struct HashFn {
+    /** \brief A caller-supplied hash function: `(key, seed) -> hash`. It must
+     * be deterministic and mix all 64 output bits well (the high bits pick the
+     * bucket).
+     */
+    using CustomFn = std::function<u64(std::string_view key, u64 seed)>;
+
+    HashFamily family_;
+    u64 seed_;
+
+    // The secret XXH3 derives from `seed_` for long (> 240 byte) inputs,
+    // computed once here instead of on every call; its first 128 bytes also
+    // key the inlined path for 17-128 byte keys.  All zero for the other
+    // families.
+    //
+    std::array<u8, XXH3_SECRET_DEFAULT_SIZE> secret_{};
+
+    // Constants XXH3 derives from `seed_` for keys of up to 16 bytes, by
+    // length class: 0, 1-3, 4-8, and 9-16 (two); see xxh3_inline.  Keys of
+    // 17-128 bytes use the words of `secret_` directly.
+    //
+    u64 xxh3_empty_ = 0;
+    u64 xxh3_bitflip_1to3_ = 0;
+    u64 xxh3_bitflip_4to8_ = 0;
+    u64 xxh3_bitflip_9to16_[2] = {0, 0};
+
+    CustomFn custom_fn_;
+
+    /** \brief An XXH3 hash function with the given seed.
+     */
+    explicit HashFn(u64 seed) noexcept : HashFn{HashFamily::kXXH3, seed}
+    {
+    }
+
+    /** \brief A built-in hash function; `family` must not be kCustom.
+     */
+    HashFn(HashFamily family, u64 seed) noexcept : family_{family}, seed_{seed}
+    {
+        BATT_CHECK(family == HashFamily::kXXH3 ||
+                   family == HashFamily::kMultiplyMix)
+            << BATT_INSPECT((u32)family);
+
+        if (family == HashFamily::kXXH3) {
+            XXH3_generateSecret_fromSeed(this->secret_.data(), this->seed_);
+            this->init_xxh3_inline();
+        }
+    }
+
+    /** \brief A caller-supplied hash function, called with `seed`.
+     */
+    HashFn(CustomFn fn, u64 seed) noexcept
+        : family_{HashFamily::kCustom}
+        , seed_{seed}
+        , custom_fn_{std::move(fn)}
+    {
+        BATT_CHECK(this->custom_fn_ != nullptr);
+    }
+
+    /** \brief An XXH3 hash function with a seed from std::random_device; the
+     * default for all tables.
+     */
+    static HashFn random() noexcept
+    {
+        return HashFn{std::random_device{}()};
+    }
+
+    /** \brief Reconstructs the HashFn recorded in a snapshot; for kCustom,
+     * `custom_fn` must be the function the snapshot was taken with.
+     */
+    static StatusOr<HashFn> restore(HashFamily family, u64 seed,
+                                    const CustomFn& custom_fn) noexcept
+    {
+        if (family == HashFamily::kCustom) {
+            if (custom_fn == nullptr) {
+                return {batt::StatusCode::kInvalidArgument};
+            }
+            return HashFn{custom_fn, seed};
+        }
+        return HashFn{family, seed};
+    }
+
+    /** \brief Returns a HashFn of the same family (and function) with a
+     * different seed.
+     */
+    HashFn with_seed(u64 seed) const noexcept
+    {
+        if (this->family_ == HashFamily::kCustom) {
+            return HashFn{this->custom_fn_, seed};
+        }
+        return HashFn{this->family_, seed};
+    }
+
+    HashFamily family() const noexcept
+    {
+        return this->family_;
+    }
+
+    u64 seed() const noexcept
+    {
+        return this->seed_;
+    }
+
+    /** \brief Returns the hash of `s`; for kXXH3, XXH3_64bits_withSeed(`s`,
+     * seed_).
+     */
+    usize operator()(const std::string_view& s) const noexcept
+    {
+        switch (this->family_) {
+            case HashFamily::kXXH3:
+                if (s.size() <= detail::kXXH3InlineMaxLen) {
+                    return this->xxh3_inline(s);
+                }
+                return XXH3_64bits_withSecretandSeed(
+                    s.data(), s.size(), this->secret_.data(),
+                    this->secret_.size(), this->seed_);
+
+            case HashFamily::kMultiplyMix:
+                return multiply_mix_hash(s, this->seed_);
+
+            case HashFamily::kCustom:
+                break;
+        }
+        return this->custom_fn_(s, this->seed_);
+    }
+
+    /** \brief Hashes `keys[begin]`, ..., `keys[end - 1]` into `out[0]`, ...,
+     * `out[end - begin - 1]`; each result is the same as operator().
+     *
+     * For XXH3, keys of up to kXXH3InlineMaxLen bytes are hashed by the
+     * inlined path with no call per key, so consecutive keys' multiplies
+     * overlap; the bytes of the key kPrefetchDistance ahead are prefetched
+     * meanwhile, for key ranges that aren't laid out sequentially in memory.
+     */
+    template <typename KeyRange>
+    void hash_batch(const KeyRange& keys, usize begin, usize end,
+                    u64* out) const noexcept
+    {
+        if (this->family_ != HashFamily::kXXH3) {
+            for (usize i = begin; i < end; ++i) {
+                out[i - begin] = (*this)(keys[i]);
+            }
+            return;
+        }
+
+        constexpr usize kPrefetchDistance = 16;
+
+        for (usize i = begin; i < end; ++i) {
+            if (i + kPrefetchDistance < end) {
+                __builtin_prefetch(
+                    std::string_view{keys[i + kPrefetchDistance]}.data());
+            }
+            const std::string_view s = keys[i];
+            out[i - begin] = (s.size() <= detail::kXXH3InlineMaxLen)
+                                 ? this->xxh3_inline(s)
+                                 : (*this)(s);
+        }
+    }
+
+   private:
+    void init_xxh3_inline() noexcept
+    {
+        using detail::read_u32_le;
+        using detail::read_u64_le;
+
+        const char* const k =
+            (const char*)detail::xxh3_default_secret().data();
+        const u64 seed = this->seed_;
+
+        this->xxh3_empty_ = detail::xxh64_avalanche(
+            seed ^ (read_u64_le(k + 56) ^ read_u64_le(k + 64)));
+
+        this->xxh3_bitflip_1to3_ =
+            (u64)(u32)(read_u32_le(k) ^ read_u32_le(k + 4)) + seed;
+
+        const u64 seed_4to8 =
+            seed ^ ((u64)__builtin_bswap32((u32)seed) << 32);
+        this->xxh3_bitflip_4to8_ =
+            (read_u64_le(k + 8) ^ read_u64_le(k + 16)) - seed_4to8;
+
+        this->xxh3_bitflip_9to16_[0] =
+            (read_u64_le(k + 24) ^ read_u64_le(k + 32)) + seed;
+        this->xxh3_bitflip_9to16_[1] =
+            (read_u64_le(k + 40) ^ read_u64_le(k + 48)) - seed;
+    }
+
+    /** \brief XXH3_64bits_withSeed(`s`, seed_) for keys of at most
+     * kXXH3InlineMaxLen bytes, from the constants precomputed for seed_.
+     */
+    u64 xxh3_inline(std::string_view s) const noexcept
+    {
+        const char* const p = s.data();
+        const usize len = s.size();
+
+        if (len <= 16) {
+            if (len > 8) {
+                return this->xxh3_9to16(p, len);
+            }
+            if (len >= 4) {
+                return this->xxh3_4to8(p, len);
+            }
+            if (len > 0) {
+                return this->xxh3_1to3(p, len);
+            }
+            return this->xxh3_empty_;
+        }
+        if (len <= 32) {
+            return this->xxh3_17to128<1>(p, len);
+        }
+        if (len <= 64) {
+            return this->xxh3_17to128<2>(p, len);
+        }
+        if (len <= 96) {
+            return this->xxh3_17to128<3>(p, len);
+        }
+        return this->xxh3_17to128<4>(p, len);
+    }
+
+    u64 xxh3_1to3(const char* p, usize len) const noexcept
+    {
+        const u32 combined = ((u32)(u8)p[0] << 16) |
+                             ((u32)(u8)p[len >> 1] << 24) |
+                             (u32)(u8)p[len - 1] | ((u32)len << 8);
+
+        return detail::xxh64_avalanche((u64)combined ^
+                                       this->xxh3_bitflip_1to3_);
+    }
+
+    u64 xxh3_4to8(const char* p, usize len) const noexcept
+    {
+        const u64 lo = detail::read_u32_le(p);
+        const u64 hi = detail::read_u32_le(p + len - 4);
+
+        return detail::xxh3_rrmxmx((hi + (lo << 32)) ^ this->xxh3_bitflip_4to8_,
+                                   len);
+    }
+
+    u64 xxh3_9to16(const char* p, usize len) const noexcept
+    {
+        const u64 lo = detail::read_u64_le(p) ^ this->xxh3_bitflip_9to16_[0];
+        const u64 hi =
+            detail::read_u64_le(p + len - 8) ^ this->xxh3_bitflip_9to16_[1];
+
+        return detail::xxh3_avalanche(len + __builtin_bswap64(lo) + hi +
+                                      detail::mum_u64(lo, hi));
+    }
+
+    /** \brief XXH3 for keys of 16 * `kPairs` + 1 to 32 * `kPairs` bytes:
+     * `kPairs` 16-byte chunks from each end, each keyed with two words of the
+     * seed's secret.
+     */
+    template <usize kPairs>
+    u64 xxh3_17to128(const char* p, usize len) const noexcept
+    {
+        using detail::read_u64_le;
+
+        const char* const secret = (const char*)this->secret_.data();
+        const auto mix16 = [secret](const char* in, usize secret_offset) {
+            return detail::mum_u64(
+                read_u64_le(in) ^ read_u64_le(secret + secret_offset),
+                read_u64_le(in + 8) ^ read_u64_le(secret + secret_offset + 8));
+        };
+
+        u64 acc = len * detail::kXXH64Prime1;
+        for (usize j = 0; j < kPairs; ++j) {
+            acc += mix16(p + 16 * j, 32 * j);
+            acc += mix16(p + len - 16 * (j + 1), 32 * j + 16);
+        }
+        return detail::xxh3_avalanche(acc);
+    }
+};
+
+}  //namespace tiny_pointers
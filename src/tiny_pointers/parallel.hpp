@@ -0,0 +1,54 @@
+#pragma once
+
+#include "imports.hpp"
+
+#include <algorithm>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace tiny_pointers {
+
+/** \brief Returns the number of threads to use when the caller asks for 0
+ * (i.e., "pick for me").
+ */
+inline usize default_thread_count(usize n_threads = 0)
+{
+    if (n_threads != 0) {
+        return n_threads;
+    }
+    return std::max<usize>(1, std::thread::hardware_concurrency());
+}
+
+/** \brief Returns the `part_i`-th of `n_parts` contiguous, nearly equal-sized
+ * sub-ranges of [0, total), as a [begin, end) pair.
+ */
+inline std::pair<usize, usize> split_range(usize total, usize n_parts,
+                                           usize part_i)
+{
+    return {total * part_i / n_parts, total * (part_i + 1) / n_parts};
+}
+
+/** \brief Invokes `fn(thread_i)` for each `thread_i` in [0, n_threads) on its
+ * own thread (thread 0 is the calling thread), and waits for all to finish.
+ */
+template <typename Fn>
+void run_parallel(usize n_threads, Fn&& fn)
+{
+    std::vector<std::thread> threads;
+    threads.reserve(n_threads);
+
+    for (usize thread_i = 1; thread_i < n_threads; ++thread_i) {
+        threads.emplace_back([&fn, thread_i] {
+            fn(thread_i);
+        });
+    }
+    if (n_threads > 0) {
+        fn(usize{0});
+    }
+    for (std::thread& t : threads) {
+        t.join();
+    }
+}
+
+}  //namespace tiny_pointers
@@ -0,0 +1,242 @@
+#pragma once
+
+#include "imports.hpp"
+#include "tiny_pointers.hpp"
+
+#include <atomic>
+#include <vector>
+
+namespace tiny_pointers {
+
+//=#=#==#==#===============+=+=+=+=++=++++++++++++++-++-+--+-+----+---------------
+
+/** \brief A SimpleDereferenceTable that supports one writer thread concurrently
+ * with any number of reader threads, without locks.
+ *
+ * Every bucket carries a version counter (a seqlock): the writer makes it odd
+ * before modifying the bucket and even again afterwards; readers (Read, Get)
+ * copy the slot value and retry if the version was odd or changed meanwhile.
+ * Readers never write shared memory, so read throughput scales with cores.
+ *
+ * Thread safety: Read, Get, and Dereference may be called from any thread.
+ * All other methods (Allocate, Free, Set, Clear) must be called from a single
+ * writer thread at a time.
+ *
+ * As with any seqlock, the reader's copy of the slot may overlap a concurrent
+ * Set; the version check discards any copy that could be torn.  Slot words are
+ * loaded and stored with relaxed atomics (see
+ * SimpleDereferenceTable::load_slot), so the overlap isn't a data race.
+ */
+class SeqLockDereferenceTable : public DereferenceTable
+{
+   public:
+    SeqLockDereferenceTable(SlotCount n, BitsPerSlot q,
+                            HashFn hash_fn = HashFn::random()) noexcept
+        : table_{n, q, std::move(hash_fn)}
+        , versions_(this->table_.bucket_count())
+    {
+    }
+
+    /** \brief The underlying table; only safe to use from the writer thread or
+     * while there is no writer.
+     */
+    const SimpleDereferenceTable& table() const noexcept
+    {
+        return this->table_;
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    // Reader methods.
+
+    /** \brief Returns the value of the slot allocated to `x`; equivalent to
+     * Get(Dereference(`x`, `p`)). Safe to call concurrently with the writer.
+     */
+    Value Read(Key x, const TinyPointer& p) const noexcept
+    {
+        Value v(this->table_.bits_per_slot());
+        this->Read(x, p, v);
+        return v;
+    }
+
+    /** \brief Copies the value of the slot allocated to `x` into `out`, which
+     * must be bits_per_slot() bits; lets a reader reuse one buffer across
+     * reads, so that no read allocates.  Safe to call concurrently with the
+     * writer.
+     */
+    void Read(Key x, const TinyPointer& p, Value& out) const noexcept
+    {
+        this->read_slot(
+            this->table_.slot_in_bucket(this->table_.find_bucket(x), p), out);
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    //
+    SlotIndex Dereference(Key x, TinyPointer p) noexcept override
+    {
+        return this->table_.Dereference(x, std::move(p));
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    //
+    SlotIndex Dereference(Key x, LocalityHint hint,
+                          TinyPointer p) noexcept override
+    {
+        return this->table_.Dereference(x, hint, std::move(p));
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    //
+    Value Get(SlotIndex i) noexcept override
+    {
+        Value v(this->table_.bits_per_slot());
+        this->read_slot(i, v);
+        return v;
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    // Writer methods.
+
+    StatusOr<TinyPointer> Allocate(Key x) noexcept override
+    {
+        const usize bucket_i = this->table_.find_bucket(x);
+        WriteGuard guard{this->versions_[bucket_i]};
+
+        return this->table_.allocate_in_bucket(bucket_i);
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    //
+    StatusOr<TinyPointer> Allocate(Key x, LocalityHint hint) noexcept override
+    {
+        (void)x;
+        const usize bucket_i = this->table_.find_bucket(hint);
+        WriteGuard guard{this->versions_[bucket_i]};
+
+        return this->table_.allocate_in_bucket(bucket_i);
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    //
+    void Free(Key x, TinyPointer p) noexcept override
+    {
+        const usize bucket_i = this->table_.find_bucket(x);
+        WriteGuard guard{this->versions_[bucket_i]};
+
+        this->table_.free_in_bucket(bucket_i, p);
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    //
+    void Free(Key x, LocalityHint hint, TinyPointer p) noexcept override
+    {
+        (void)x;
+        const usize bucket_i = this->table_.find_bucket(hint);
+        WriteGuard guard{this->versions_[bucket_i]};
+
+        this->table_.free_in_bucket(bucket_i, p);
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    //
+    void Set(SlotIndex i, Value v) noexcept override
+    {
+        WriteGuard guard{this->versions_[this->bucket_of(i)]};
+
+        this->table_.Set(i, std::move(v));
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    //
+    void Clear() noexcept override
+    {
+        // Clear only touches bucket metadata, never slot values, so readers
+        // are unaffected.
+        //
+        this->table_.Clear();
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    //
+    MemoryFootprint footprint() const noexcept override
+    {
+        // The underlying table's footprint, plus one cache line per bucket for
+        // the version counters.
+        //
+        MemoryFootprint result = this->table_.footprint();
+        result.metadata_bytes += sizeof(*this) - sizeof(this->table_) +
+                                 this->versions_.size() * sizeof(BucketVersion);
+        return result;
+    }
+
+   private:
+    /** \brief A bucket version counter, alone on its cache line so that readers
+     * of one bucket aren't slowed by writes to another.
+     */
+    struct alignas(64) BucketVersion {
+        std::atomic<u64> value{0};
+    };
+
+    /** \brief Makes a bucket's version odd for the duration of a write.
+     */
+    class WriteGuard
+    {
+       public:
+        explicit WriteGuard(BucketVersion& version) noexcept
+            : version_{version.value}
+            , start_{this->version_.load(std::memory_order_relaxed)}
+        {
+            this->version_.store(this->start_ + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+
+        WriteGuard(const WriteGuard&) = delete;
+        WriteGuard& operator=(const WriteGuard&) = delete;
+
+        ~WriteGuard() noexcept
+        {
+            this->version_.store(this->start_ + 2, std::memory_order_release);
+        }
+
+       private:
+        std::atomic<u64>& version_;
+        const u64 start_;
+    };
+
+    //+++++++++++-+-+--+----- --- -- -  -  -   -
+
+    usize bucket_of(SlotIndex i) const noexcept
+    {
+        return i / this->table_.slots_per_bucket();
+    }
+
+    /** \brief Copies slot `i` into `out` (bits_per_slot() bits).  The slot
+     * words are read with relaxed atomic loads into `out`'s existing storage,
+     * so retries neither allocate nor race with the writer's (atomic) stores.
+     */
+    void read_slot(SlotIndex i, Value& out) const noexcept
+    {
+        const std::atomic<u64>& version =
+            this->versions_[this->bucket_of(i)].value;
+
+        for (;;) {
+            const u64 before = version.load(std::memory_order_acquire);
+            if (before & 1) {
+                continue;
+            }
+
+            this->table_.load_slot(i, out);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (version.load(std::memory_order_relaxed) == before) {
+                return;
+            }
+        }
+    }
+
+    //+++++++++++-+-+--+----- --- -- -  -  -   -
+
+    SimpleDereferenceTable table_;
+    std::vector<BucketVersion> versions_;
+};
+
+}  //namespace tiny_pointers
@@ -0,0 +1,103 @@
+#include <tiny_pointers/seq_lock_dereference_table.hpp>
+//
+#include <tiny_pointers/seq_lock_dereference_table.hpp>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using namespace batt::int_types;
+using tiny_pointers::BitsPerSlot;
+using tiny_pointers::SeqLockDereferenceTable;
+using tiny_pointers::SlotCount;
+using tiny_pointers::SlotIndex;
+using tiny_pointers::StatusOr;
+using tiny_pointers::TinyPointer;
+using tiny_pointers::Value;
+
+/** \brief Returns a value whose words all equal `n`, so a torn read (a mix of
+ * two writes) is detectable.
+ */
+Value make_value(usize q, u64 n)
+{
+    Value v(q);
+    for (usize i = 0; i < v.word_count(); ++i) {
+        v.data()[i] = n;
+    }
+    return v;
+}
+
+TEST(SeqLockDereferenceTableTest, ConcurrentReaders)
+{
+    constexpr usize kQ = 64 * 4;
+    constexpr usize kNumKeys = 64;
+    constexpr usize kNumReaders = 4;
+
+    SeqLockDereferenceTable table{SlotCount{100000}, BitsPerSlot{kQ}};
+
+    std::vector<std::string> keys;
+    std::vector<TinyPointer> ptrs;
+    for (usize i = 0; i < kNumKeys; ++i) {
+        keys.emplace_back("key" + std::to_string(i));
+        StatusOr<TinyPointer> p = table.Allocate(keys.back());
+        ASSERT_TRUE(p.ok());
+        table.Set(table.Dereference(keys.back(), *p), make_value(kQ, 0));
+        ptrs.emplace_back(std::move(*p));
+    }
+
+    std::atomic<bool> done{false};
+    std::atomic<usize> torn_reads{0};
+    std::atomic<usize> total_reads{0};
+
+    std::vector<std::thread> readers;
+    for (usize r = 0; r < kNumReaders; ++r) {
+        readers.emplace_back([&, r] {
+            // Reuse one buffer for every read; see Read(x, p, out).
+            //
+            Value v(kQ);
+            usize reads = 0;
+            for (usize i = r; !done.load(); i = (i + 1) % kNumKeys, ++reads) {
+                table.Read(keys[i], ptrs[i], v);
+                for (usize w = 1; w < v.word_count(); ++w) {
+                    if (v.data()[w] != v.data()[0]) {
+                        torn_reads.fetch_add(1);
+                        break;
+                    }
+                }
+            }
+            total_reads.fetch_add(reads);
+        });
+    }
+
+    // The writer keeps rewriting every value, and churns allocations.
+    //
+    for (u64 n = 1; n <= 2000; ++n) {
+        for (usize i = 0; i < kNumKeys; ++i) {
+            table.Set(table.Dereference(keys[i], ptrs[i]), make_value(kQ, n));
+        }
+        const std::string scratch = "scratch" + std::to_string(n);
+        StatusOr<TinyPointer> p = table.Allocate(scratch);
+        ASSERT_TRUE(p.ok());
+        table.Free(scratch, *p);
+    }
+
+    done.store(true);
+    for (std::thread& t : readers) {
+        t.join();
+    }
+
+    EXPECT_EQ(torn_reads.load(), 0);
+    EXPECT_GT(total_reads.load(), 0);
+    for (usize i = 0; i < kNumKeys; ++i) {
+        EXPECT_EQ(table.Read(keys[i], ptrs[i]).data()[0], 2000);
+    }
+    EXPECT_EQ(table.table().size(), kNumKeys);
+}
+
+}  // namespace
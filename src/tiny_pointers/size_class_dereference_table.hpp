@@ -0,0 +1,365 @@
+#pragma once
+
+#include "imports.hpp"
+#include "tiny_pointers.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+namespace tiny_pointers {
+
+//=#=#==#==#===============+=+=+=+=++=++++++++++++++-++-+--+-+----+---------------
+
+/** \brief The slot size and slot count of one size class.
+ */
+struct SizeClass {
+    BitsPerSlot q;
+    SlotCount n;
+};
+
+/** \brief Returns the slot sizes of geometrically growing size classes: from
+ * `min_q` up to `max_q` (always the last class), each `growth_factor` times
+ * the previous one (rounded up to a whole bit).
+ */
+inline std::vector<BitsPerSlot> size_class_slot_sizes(BitsPerSlot min_q,
+                                                      BitsPerSlot max_q,
+                                                      double growth_factor)
+{
+    BATT_CHECK_LE(min_q, max_q);
+    BATT_CHECK_GT(growth_factor, 1.0);
+
+    std::vector<BitsPerSlot> sizes;
+    usize q = min_q;
+    while (q < max_q) {
+        sizes.emplace_back(q);
+        q = std::max<usize>(q + 1, std::ceil((double)q * growth_factor));
+    }
+    sizes.push_back(max_q);
+
+    return sizes;
+}
+
+/** \brief Returns size classes with slot sizes from size_class_slot_sizes
+ * that together hold `n` values, split in proportion to `weights` (one per
+ * slot size; e.g., the number of values expected in each class).
+ *
+ * Every class gets at least `min_class_slots` slots so that values can spill
+ * into it from smaller classes. A class whose slots are too small for its own
+ * table geometry (q < SimpleDereferenceTable::min_bits_per_slot) is widened,
+ * and merged with the next class if that makes them the same size.
+ */
+inline std::vector<SizeClass> make_size_classes(
+    SlotCount n, const std::vector<BitsPerSlot>& slot_sizes,
+    const std::vector<double>& weights, usize min_class_slots = 64)
+{
+    BATT_CHECK(!slot_sizes.empty());
+    BATT_CHECK_EQ(slot_sizes.size(), weights.size());
+
+    double total_weight = 0;
+    for (double w : weights) {
+        BATT_CHECK_GE(w, 0.0);
+        total_weight += w;
+    }
+
+    std::vector<SizeClass> classes;
+    for (usize i = 0; i < slot_sizes.size(); ++i) {
+        const usize share =
+            (total_weight > 0)
+                ? (usize)std::ceil((double)n * weights[i] / total_weight)
+                : (n + slot_sizes.size() - 1) / slot_sizes.size();
+
+        SizeClass c{
+            .q = slot_sizes[i],
+            .n = SlotCount{std::max<usize>(share, min_class_slots)},
+        };
+        c.q = BitsPerSlot{std::max<usize>(
+            c.q, SimpleDereferenceTable::min_bits_per_slot(c.n))};
+
+        if (!classes.empty() && classes.back().q >= c.q) {
+            classes.back().n = SlotCount{classes.back().n + c.n};
+            classes.back().q = BitsPerSlot{std::max<usize>(
+                classes.back().q,
+                SimpleDereferenceTable::min_bits_per_slot(classes.back().n))};
+        } else {
+            classes.push_back(c);
+        }
+    }
+
+    return classes;
+}
+
+/** \brief Returns size classes for values of up to `max_q` bits, with `n`
+ * slots in total split evenly between the classes (see the overload above).
+ */
+inline std::vector<SizeClass> make_size_classes(SlotCount n, BitsPerSlot min_q,
+                                                BitsPerSlot max_q,
+                                                double growth_factor = 1.25)
+{
+    const std::vector<BitsPerSlot> slot_sizes =
+        size_class_slot_sizes(min_q, max_q, growth_factor);
+
+    return make_size_classes(n, slot_sizes,
+                             std::vector<double>(slot_sizes.size(), 1.0));
+}
+
+/** \brief Returns size classes for values of up to `max_q` bits, with `n`
+ * slots in total split in proportion to how many of `sample_value_bits` (the
+ * sizes, in bits, of a representative sample of values) fall in each class.
+ */
+inline std::vector<SizeClass> make_size_classes(
+    SlotCount n, const std::vector<usize>& sample_value_bits, BitsPerSlot min_q,
+    BitsPerSlot max_q, double growth_factor = 1.25)
+{
+    const std::vector<BitsPerSlot> slot_sizes =
+        size_class_slot_sizes(min_q, max_q, growth_factor);
+
+    std::vector<double> histogram(slot_sizes.size(), 0.0);
+    for (usize value_bits : sample_value_bits) {
+        const auto iter =
+            std::lower_bound(slot_sizes.begin(), slot_sizes.end(), value_bits);
+        BATT_CHECK(iter != slot_sizes.end())
+            << "sample value larger than max_q" << BATT_INSPECT(value_bits);
+
+        histogram[iter - slot_sizes.begin()] += 1.0;
+    }
+
+    return make_size_classes(n, slot_sizes, histogram);
+}
+
+/** \brief Identifies a slot in a SizeClassDereferenceTable.
+ */
+struct SizeClassSlot {
+    usize size_class;
+    SlotIndex slot;
+};
+
+//=#=#==#==#===============+=+=+=+=++=++++++++++++++-++-+--+-+----+---------------
+
+/** \brief A slab of SimpleDereferenceTables with different slot sizes, for
+ * variable-length values.
+ *
+ * Allocate routes each key to the smallest size class whose slots can hold
+ * the requested number of bits (falling back to larger classes if that one is
+ * full), so values are padded by at most the growth factor between classes
+ * rather than to the largest record size.
+ *
+ * The tiny pointer is the size class index followed by the tiny pointer
+ * returned by that class's table; its size is log(#classes) + max p bits.
+ */
+class SizeClassDereferenceTable
+{
+   public:
+    using CheckPolicy = DefaultCheckPolicy;
+
+    /** \brief Creates one table per size class. Class `i` hashes keys with
+     * `hash_fn.with_seed(mix_u64(hash_fn.seed() + i))`, so that a key's
+     * fallback classes don't place it in correlated buckets.
+     *
+     * The classes must be sorted by slot size, and each slot size must be at
+     * least SimpleDereferenceTable::min_bits_per_slot of its slot count (as
+     * returned by make_size_classes).
+     */
+    explicit SizeClassDereferenceTable(const std::vector<SizeClass>& classes,
+                                       HashFn hash_fn = HashFn::random()) noexcept
+        : class_bits_{log2_ceil(classes.size())}
+        , slot_bits_{0}
+    {
+        BATT_CHECK(!classes.empty());
+
+        for (const SizeClass& c : classes) {
+            BATT_CHECK(this->tables_.empty() ||
+                       c.q > this->tables_.back()->bits_per_slot())
+                << "size classes must be sorted by slot size";
+            BATT_CHECK_GE(c.q, SimpleDereferenceTable::min_bits_per_slot(c.n))
+                << "slot size too small for the size class's slot count";
+
+            this->tables_.emplace_back(std::make_unique<SimpleDereferenceTable>(
+                c.n, c.q,
+                hash_fn.with_seed(
+                    mix_u64(hash_fn.seed() + this->tables_.size()))));
+
+            this->slot_bits_ = std::max<i32>(
+                this->slot_bits_, this->tables_.back()->tiny_pointer_size());
+        }
+        this->p_bits_ = this->class_bits_ + this->slot_bits_;
+
+        BATT_CHECK_LE(this->p_bits_, 64);
+    }
+
+    /** \brief The number of size classes.
+     */
+    usize size_class_count() const noexcept
+    {
+        return this->tables_.size();
+    }
+
+    /** \brief The table backing size class `i`.
+     */
+    const SimpleDereferenceTable& table(usize i) const noexcept
+    {
+        return *this->tables_[i];
+    }
+
+    /** \brief The size of TinyPointers returned by this.
+     */
+    usize tiny_pointer_size() const noexcept
+    {
+        return this->p_bits_;
+    }
+
+    /** \brief The current number of active allocations, over all classes.
+     */
+    usize size() const noexcept
+    {
+        usize total = 0;
+        for (const auto& table : this->tables_) {
+            total += table->size();
+        }
+        return total;
+    }
+
+    /** \brief Returns the memory used by all size classes together.
+     */
+    MemoryFootprint footprint() const noexcept
+    {
+        MemoryFootprint result{
+            .metadata_bytes = sizeof(*this) + this->tables_.capacity() *
+                                                  sizeof(this->tables_[0]),
+            .tiny_pointer_bits = (usize)this->p_bits_,
+        };
+        for (const auto& table : this->tables_) {
+            const MemoryFootprint f = table->footprint();
+            result.storage_bytes += f.storage_bytes;
+            result.metadata_bytes += f.metadata_bytes;
+            result.live_entries += f.live_entries;
+        }
+        return result;
+    }
+
+    /** \brief Returns the smallest size class that can hold a value of
+     * `value_bits` bits, or None if the value is too large for every class.
+     */
+    Optional<usize> size_class_for(usize value_bits) const noexcept
+    {
+        const auto iter =
+            std::partition_point(this->tables_.begin(), this->tables_.end(),
+                                 [value_bits](const auto& table) {
+                                     return table->bits_per_slot() < value_bits;
+                                 });
+        if (iter == this->tables_.end()) {
+            return batt::None;
+        }
+        return iter - this->tables_.begin();
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    /** \brief Allocates a slot of at least `value_bits` bits to `x`.
+     *
+     * Returns kInvalidArgument if no size class is large enough, and
+     * kResourceExhausted if all large-enough classes are full.
+     */
+    StatusOr<TinyPointer> Allocate(Key x, usize value_bits) noexcept
+    {
+        const Optional<usize> first_class = this->size_class_for(value_bits);
+        if (!first_class) {
+            return {batt::StatusCode::kInvalidArgument};
+        }
+
+        for (usize c = *first_class; c < this->tables_.size(); ++c) {
+            StatusOr<TinyPointer> p = this->tables_[c]->Allocate(x);
+            if (p.ok()) {
+                return TinyPointer{this->p_bits_,
+                                   (c << this->slot_bits_) | p->int_value()};
+            }
+        }
+        return {batt::StatusCode::kResourceExhausted};
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    //
+    SizeClassSlot Dereference(Key x, const TinyPointer& p) noexcept
+    {
+        const usize c = this->class_of(p);
+
+        return SizeClassSlot{
+            .size_class = c,
+            .slot = this->tables_[c]->Dereference(x, this->class_pointer(c, p)),
+        };
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    //
+    void Free(Key x, const TinyPointer& p) noexcept
+    {
+        const usize c = this->class_of(p);
+
+        this->tables_[c]->Free(x, this->class_pointer(c, p));
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    //
+    void Set(const SizeClassSlot& i, const Value& v) noexcept
+    {
+        TINY_POINTERS_CHECK_LT(CheckPolicy, i.size_class, this->tables_.size());
+
+        this->tables_[i.size_class]->Set(i.slot, v);
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    //
+    Value Get(const SizeClassSlot& i) const noexcept
+    {
+        TINY_POINTERS_CHECK_LT(CheckPolicy, i.size_class, this->tables_.size());
+
+        return std::as_const(*this->tables_[i.size_class]).Get(i.slot);
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    //
+    void Clear() noexcept
+    {
+        for (const auto& table : this->tables_) {
+            table->Clear();
+        }
+    }
+
+   private:
+    usize class_of(const TinyPointer& p) const noexcept
+    {
+        TINY_POINTERS_CHECK_EQ(CheckPolicy, p.size(), this->p_bits_);
+
+        const usize c = p.int_value() >> this->slot_bits_;
+        TINY_POINTERS_CHECK_LT(CheckPolicy, c, this->tables_.size());
+
+        return c;
+    }
+
+    TinyPointer class_pointer(usize c, const TinyPointer& p) const noexcept
+    {
+        return TinyPointer{this->tables_[c]->tiny_pointer_size(),
+                           p.int_value() & low_bits_mask(this->slot_bits_)};
+    }
+
+    //+++++++++++-+-+--+----- --- -- -  -  -   -
+
+    // The number of bits used to encode the size class.
+    //
+    const i32 class_bits_;
+
+    // The number of bits used to encode the per-class tiny pointer (the max
+    // over all classes).
+    //
+    i32 slot_bits_;
+
+    // The TinyPointer size, in bits.
+    //
+    i32 p_bits_;
+
+    // One table per size class, in increasing order of slot size.
+    //
+    std::vector<std::unique_ptr<SimpleDereferenceTable>> tables_;
+};
+
+}  //namespace tiny_pointers
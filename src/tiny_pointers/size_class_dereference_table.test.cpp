@@ -0,0 +1,173 @@
+#include <tiny_pointers/size_class_dereference_table.hpp>
+//
+#include <tiny_pointers/size_class_dereference_table.hpp>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+using namespace batt::int_types;
+using tiny_pointers::BitsPerSlot;
+using tiny_pointers::make_size_classes;
+using tiny_pointers::SizeClass;
+using tiny_pointers::SizeClassDereferenceTable;
+using tiny_pointers::SimpleDereferenceTable;
+using tiny_pointers::SizeClassSlot;
+using tiny_pointers::SlotCount;
+using tiny_pointers::StatusOr;
+using tiny_pointers::TinyPointer;
+using tiny_pointers::Value;
+
+TEST(SizeClassDereferenceTableTest, MakeSizeClasses)
+{
+    const std::vector<SizeClass> classes =
+        make_size_classes(SlotCount{1000}, BitsPerSlot{32}, BitsPerSlot{256});
+
+    ASSERT_GT(classes.size(), 2);
+    EXPECT_EQ(classes.front().q, 32);
+    EXPECT_EQ(classes.back().q, 256);
+    for (usize i = 1; i < classes.size(); ++i) {
+        EXPECT_GT(classes[i].q, classes[i - 1].q);
+        EXPECT_LE(classes[i].q, std::ceil(classes[i - 1].q * 1.25));
+    }
+
+    // The slots are split between the classes, not repeated in each.
+    //
+    usize total_slots = 0;
+    for (const SizeClass& c : classes) {
+        total_slots += c.n;
+    }
+    EXPECT_GE(total_slots, 1000u);
+    EXPECT_LE(total_slots, 1000u + 64 * classes.size());
+}
+
+TEST(SizeClassDereferenceTableTest, MakeSizeClassesFromHistogram)
+{
+    // Mostly small values, a few large ones.
+    //
+    std::vector<usize> sample;
+    for (usize i = 0; i < 1000; ++i) {
+        sample.push_back((i % 100 == 0) ? 500 : 30 + i % 10);
+    }
+
+    const std::vector<SizeClass> classes = make_size_classes(
+        SlotCount{100000}, sample, BitsPerSlot{32}, BitsPerSlot{512});
+
+    ASSERT_GT(classes.size(), 2);
+    EXPECT_EQ(classes.back().q, 512);
+
+    usize small_slots = 0;
+    usize total_slots = 0;
+    for (const SizeClass& c : classes) {
+        total_slots += c.n;
+        if (c.q <= 40) {
+            small_slots += c.n;
+        }
+    }
+    EXPECT_GE(small_slots, 99000u);
+    EXPECT_LE(total_slots, 100000u + 64 * classes.size());
+}
+
+TEST(SizeClassDereferenceTableTest, MinSlotSizeIsClamped)
+{
+    // 4-bit slots are too small to build a table of this many slots (which
+    // needs q >= log n); the small classes are widened and merged instead.
+    //
+    const std::vector<SizeClass> classes =
+        make_size_classes(SlotCount{1 << 20}, BitsPerSlot{4}, BitsPerSlot{64});
+
+    for (usize i = 0; i < classes.size(); ++i) {
+        EXPECT_GE(classes[i].q, SimpleDereferenceTable::min_bits_per_slot(
+                                    classes[i].n));
+        if (i > 0) {
+            EXPECT_GT(classes[i].q, classes[i - 1].q);
+        }
+    }
+
+    SizeClassDereferenceTable table{classes};
+    EXPECT_TRUE(table.Allocate("key", 4).ok());
+}
+
+TEST(SizeClassDereferenceTableTest, MixedSizes)
+{
+    SizeClassDereferenceTable table{
+        make_size_classes(SlotCount{100000}, BitsPerSlot{32}, BitsPerSlot{512})};
+
+    std::cerr << BATT_INSPECT(table.size_class_count())
+              << BATT_INSPECT(table.tiny_pointer_size()) << std::endl;
+
+    std::default_random_engine rng{1};
+    std::uniform_int_distribution<usize> pick_size{1, 512};
+
+    std::vector<std::string> keys;
+    std::vector<TinyPointer> ptrs;
+    std::vector<usize> sizes;
+    for (usize i = 0; i < 5000; ++i) {
+        keys.emplace_back("key" + std::to_string(i));
+        sizes.push_back(pick_size(rng));
+
+        StatusOr<TinyPointer> p = table.Allocate(keys.back(), sizes.back());
+        ASSERT_TRUE(p.ok());
+        EXPECT_EQ(p->size(), table.tiny_pointer_size());
+
+        // Routed to the tightest class.
+        //
+        const SizeClassSlot slot = table.Dereference(keys.back(), *p);
+        EXPECT_EQ(slot.size_class, *table.size_class_for(sizes.back()));
+        EXPECT_GE(table.table(slot.size_class).bits_per_slot(), sizes.back());
+
+        Value v(sizes.back());
+        v.set(0, true);
+        v.set(sizes.back() - 1, true);
+        v.set(i % sizes.back(), true);
+        table.Set(slot, v);
+
+        ptrs.emplace_back(std::move(*p));
+    }
+    EXPECT_EQ(table.size(), keys.size());
+
+    // Near-tight memory: far less than one table of max-size slots.
+    //
+    {
+        const SimpleDereferenceTable max_q_table{SlotCount{100000},
+                                                 BitsPerSlot{512}};
+        EXPECT_LT(table.footprint().storage_bytes,
+                  max_q_table.footprint().storage_bytes / 3);
+    }
+
+    {
+        usize storage_bytes = 0;
+        for (usize c = 0; c < table.size_class_count(); ++c) {
+            storage_bytes += table.table(c).footprint().storage_bytes;
+        }
+        const auto footprint = table.footprint();
+        EXPECT_EQ(footprint.storage_bytes, storage_bytes);
+        EXPECT_EQ(footprint.live_entries, keys.size());
+        EXPECT_EQ(footprint.tiny_pointer_bits, table.tiny_pointer_size());
+    }
+
+    for (usize i = 0; i < keys.size(); ++i) {
+        const Value v = table.Get(table.Dereference(keys[i], ptrs[i]));
+        for (usize b = 0; b < sizes[i]; ++b) {
+            EXPECT_EQ(v[b], b == 0 || b == sizes[i] - 1 || b == i % sizes[i])
+                << BATT_INSPECT(i) << BATT_INSPECT(b);
+        }
+    }
+
+    for (usize i = 0; i < keys.size(); ++i) {
+        table.Free(keys[i], ptrs[i]);
+    }
+    EXPECT_EQ(table.size(), 0);
+
+    // Too large for every class.
+    //
+    EXPECT_EQ(table.Allocate("too big", 513).status(),
+              batt::StatusCode::kInvalidArgument);
+}
+
+}  // namespace
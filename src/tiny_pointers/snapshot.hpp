@@ -0,0 +1,221 @@
+#pragma once
+
+#include "bit_vec.hpp"
+#include "hash_fn.hpp"
+#include "imports.hpp"
+
+#include <bit>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+namespace tiny_pointers {
+
+// Snapshots are written in little-endian byte order; words are streamed
+// straight out of memory, so only little-endian hosts are supported.
+//
+static_assert(std::endian::native == std::endian::little);
+
+//=#=#==#==#===============+=+=+=+=++=++++++++++++++-++-+--+-+----+---------------
+
+/** \brief The first 8 bytes of every snapshot.
+ */
+constexpr std::string_view kSnapshotMagic{"TNYPTRS\0", 8};
+
+/** \brief Bumped whenever the snapshot format changes incompatibly.
+ */
+constexpr u32 kSnapshotVersion = 1;
+
+/** \brief Limits on the geometry a table will accept from a snapshot header,
+ * so that a corrupt header is reported as kDataLoss instead of attempting an
+ * enormous allocation: at most 2^40 slots, of at most 2^20 bits each, and at
+ * most 2^46 bits (8 TiB) of storage in all.
+ */
+constexpr u64 kMaxSnapshotSlots = u64{1} << 40;
+constexpr u64 kMaxSnapshotBitsPerSlot = u64{1} << 20;
+constexpr u64 kMaxSnapshotStoreBits = u64{1} << 46;
+
+/** \brief Returns true iff `n` slots of `q` bits are within the limits above
+ * (for the slot count after rounding, `n_slots`).
+ */
+inline bool snapshot_geometry_ok(u64 n, u64 n_slots, u64 q) noexcept
+{
+    return n >= 2 && n_slots <= kMaxSnapshotSlots && q >= 1 &&
+           q <= kMaxSnapshotBitsPerSlot && n_slots * q <= kMaxSnapshotStoreBits;
+}
+
+/** \brief Identifies the kind of table a snapshot holds.
+ */
+enum struct SnapshotLayout : u32 {
+    kSimple = 1,
+    kFunnel = 2,
+};
+
+/** \brief The fixed-size header at the start of a table snapshot. Everything
+ * needed to reconstruct the table's geometry (via its constructor) is here;
+ * the table-specific metadata and storage follow.
+ */
+struct SnapshotHeader {
+    SnapshotLayout layout;
+    // The hash function family used to map keys to buckets; the seed below
+    // is only meaningful for this family.
+    //
+    HashFamily hash_family;
+
+    // n, as passed to the table's constructor.
+    //
+    u64 n;
+
+    // q - the value size.
+    //
+    u64 q;
+
+    // The TinyPointer size, in bits.
+    //
+    u64 p_bits;
+
+    u64 seed;
+    double delta;
+
+    // The number of active allocations.
+    //
+    u64 size;
+};
+
+//=#=#==#==#===============+=+=+=+=++=++++++++++++++-++-+--+-+----+---------------
+
+inline Status write_bytes(std::ostream& out, const void* data, usize n_bytes)
+{
+    out.write(static_cast<const char*>(data), n_bytes);
+    if (!out.good()) {
+        return {batt::StatusCode::kInternal};
+    }
+    return batt::OkStatus();
+}
+
+inline Status read_bytes(std::istream& in, void* data, usize n_bytes)
+{
+    in.read(static_cast<char*>(data), n_bytes);
+    if (!in.good() || (usize)in.gcount() != n_bytes) {
+        return {batt::StatusCode::kDataLoss};
+    }
+    return batt::OkStatus();
+}
+
+inline Status write_u64(std::ostream& out, u64 value)
+{
+    return write_bytes(out, &value, sizeof(value));
+}
+
+inline StatusOr<u64> read_u64(std::istream& in)
+{
+    u64 value = 0;
+    BATT_REQUIRE_OK(read_bytes(in, &value, sizeof(value)));
+    return value;
+}
+
+/** \brief Writes the words of `v` (and their count); the words are streamed
+ * directly, without an intermediate copy.
+ */
+inline Status write_words(std::ostream& out, const std::vector<u64>& v)
+{
+    BATT_REQUIRE_OK(write_u64(out, v.size()));
+    return write_bytes(out, v.data(), v.size() * sizeof(u64));
+}
+
+/** \brief Reads words written by write_words into `v`, which must already have
+ * the expected size.
+ */
+inline Status read_words(std::istream& in, std::vector<u64>& v)
+{
+    BATT_ASSIGN_OK_RESULT(const u64 count, read_u64(in));
+    if (count != v.size()) {
+        return {batt::StatusCode::kDataLoss};
+    }
+    return read_bytes(in, v.data(), v.size() * sizeof(u64));
+}
+
+/** \brief Writes the bit size and words of `v`.
+ */
+inline Status write_bit_vec(std::ostream& out, const BitVec& v)
+{
+    BATT_REQUIRE_OK(write_u64(out, v.size()));
+    return write_bytes(out, v.data(), v.word_count() * sizeof(u64));
+}
+
+/** \brief Reads a BitVec written by write_bit_vec into `v`, which must already
+ * have the expected size.
+ */
+inline Status read_bit_vec(std::istream& in, BitVec& v)
+{
+    BATT_ASSIGN_OK_RESULT(const u64 bit_size, read_u64(in));
+    if (bit_size != v.size()) {
+        return {batt::StatusCode::kDataLoss};
+    }
+    return read_bytes(in, v.data(), v.word_count() * sizeof(u64));
+}
+
+//=#=#==#==#===============+=+=+=+=++=++++++++++++++-++-+--+-+----+---------------
+
+inline Status write_snapshot_header(std::ostream& out,
+                                    const SnapshotHeader& header)
+{
+    BATT_REQUIRE_OK(write_bytes(out, kSnapshotMagic.data(), kSnapshotMagic.size()));
+    BATT_REQUIRE_OK(write_u64(out, (u64{static_cast<u32>(header.layout)} << 32) |
+                                       kSnapshotVersion));
+    BATT_REQUIRE_OK(write_u64(out, static_cast<u32>(header.hash_family)));
+    BATT_REQUIRE_OK(write_u64(out, header.n));
+    BATT_REQUIRE_OK(write_u64(out, header.q));
+    BATT_REQUIRE_OK(write_u64(out, header.p_bits));
+    BATT_REQUIRE_OK(write_u64(out, header.seed));
+    BATT_REQUIRE_OK(write_u64(out, std::bit_cast<u64>(header.delta)));
+    BATT_REQUIRE_OK(write_u64(out, header.size));
+
+    return batt::OkStatus();
+}
+
+/** \brief Reads and validates a snapshot header; returns kDataLoss if the
+ * stream is truncated or isn't a snapshot, kUnimplemented if it was written by
+ * an incompatible version or names an unknown hash family, and
+ * kInvalidArgument if it holds a different layout than `expected_layout`.
+ */
+inline StatusOr<SnapshotHeader> read_snapshot_header(
+    std::istream& in, SnapshotLayout expected_layout)
+{
+    char magic[kSnapshotMagic.size()];
+    BATT_REQUIRE_OK(read_bytes(in, magic, sizeof(magic)));
+    if (std::string_view{magic, sizeof(magic)} != kSnapshotMagic) {
+        return {batt::StatusCode::kDataLoss};
+    }
+
+    BATT_ASSIGN_OK_RESULT(const u64 layout_and_version, read_u64(in));
+    if ((layout_and_version & 0xffffffffull) != kSnapshotVersion) {
+        return {batt::StatusCode::kUnimplemented};
+    }
+
+    SnapshotHeader header;
+    header.layout = static_cast<SnapshotLayout>(layout_and_version >> 32);
+    if (header.layout != expected_layout) {
+        return {batt::StatusCode::kInvalidArgument};
+    }
+
+    BATT_ASSIGN_OK_RESULT(const u64 hash_family, read_u64(in));
+    header.hash_family = static_cast<HashFamily>(hash_family);
+    if (hash_family < static_cast<u32>(HashFamily::kXXH3) ||
+        hash_family > static_cast<u32>(HashFamily::kCustom)) {
+        return {batt::StatusCode::kUnimplemented};
+    }
+
+    BATT_ASSIGN_OK_RESULT(header.n, read_u64(in));
+    BATT_ASSIGN_OK_RESULT(header.q, read_u64(in));
+    BATT_ASSIGN_OK_RESULT(header.p_bits, read_u64(in));
+    BATT_ASSIGN_OK_RESULT(header.seed, read_u64(in));
+    BATT_ASSIGN_OK_RESULT(const u64 delta_bits, read_u64(in));
+    header.delta = std::bit_cast<double>(delta_bits);
+    BATT_ASSIGN_OK_RESULT(header.size, read_u64(in));
+
+    return header;
+}
+
+}  //namespace tiny_pointers
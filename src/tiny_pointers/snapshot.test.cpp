@@ -0,0 +1,114 @@
+#include <tiny_pointers/snapshot.hpp>
+//
+#include <tiny_pointers/snapshot.hpp>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <sstream>
+
+namespace {
+
+using namespace batt::int_types;
+using tiny_pointers::BitVec;
+using tiny_pointers::HashFamily;
+using tiny_pointers::read_bit_vec;
+using tiny_pointers::read_snapshot_header;
+using tiny_pointers::SnapshotHeader;
+using tiny_pointers::SnapshotLayout;
+using tiny_pointers::StatusOr;
+using tiny_pointers::write_bit_vec;
+using tiny_pointers::write_snapshot_header;
+
+TEST(SnapshotTest, HeaderRoundTrip)
+{
+    const SnapshotHeader header{
+        .layout = SnapshotLayout::kSimple,
+        .hash_family = HashFamily::kXXH3,
+        .n = 12345,
+        .q = 64,
+        .p_bits = 17,
+        .seed = 0xfeedface,
+        .delta = 1.0 / 17,
+        .size = 99,
+    };
+
+    std::stringstream ss;
+    ASSERT_TRUE(write_snapshot_header(ss, header).ok());
+
+    StatusOr<SnapshotHeader> result =
+        read_snapshot_header(ss, SnapshotLayout::kSimple);
+    ASSERT_TRUE(result.ok());
+    EXPECT_EQ(result->n, header.n);
+    EXPECT_EQ(result->q, header.q);
+    EXPECT_EQ(result->p_bits, header.p_bits);
+    EXPECT_EQ(result->seed, header.seed);
+    EXPECT_EQ(result->delta, header.delta);
+    EXPECT_EQ(result->size, header.size);
+
+    // Wrong layout.
+    //
+    ss.seekg(0);
+    EXPECT_EQ(read_snapshot_header(ss, SnapshotLayout::kFunnel).status(),
+              batt::StatusCode::kInvalidArgument);
+
+    // Truncated.
+    //
+    std::stringstream truncated{ss.str().substr(0, 20)};
+    EXPECT_EQ(read_snapshot_header(truncated, SnapshotLayout::kSimple).status(),
+              batt::StatusCode::kDataLoss);
+
+    // Other hash families round-trip; unknown ones are rejected.
+    //
+    for (HashFamily family :
+         {HashFamily::kMultiplyMix, HashFamily::kCustom,
+          static_cast<HashFamily>(4)}) {
+        SnapshotHeader other = header;
+        other.hash_family = family;
+
+        std::stringstream ss2;
+        ASSERT_TRUE(write_snapshot_header(ss2, other).ok());
+
+        StatusOr<SnapshotHeader> result2 =
+            read_snapshot_header(ss2, SnapshotLayout::kSimple);
+        if (family == static_cast<HashFamily>(4)) {
+            EXPECT_EQ(result2.status(), batt::StatusCode::kUnimplemented);
+        } else {
+            ASSERT_TRUE(result2.ok());
+            EXPECT_EQ(result2->hash_family, family);
+        }
+    }
+
+    // Not a snapshot.
+    //
+    std::string corrupt = ss.str();
+    corrupt[0] = 'X';
+    std::stringstream bad_magic{corrupt};
+    EXPECT_EQ(read_snapshot_header(bad_magic, SnapshotLayout::kSimple).status(),
+              batt::StatusCode::kDataLoss);
+}
+
+TEST(SnapshotTest, BitVecRoundTrip)
+{
+    BitVec src(1000);
+    for (usize i = 0; i < src.size(); i += 3) {
+        src.set(i);
+    }
+
+    std::stringstream ss;
+    ASSERT_TRUE(write_bit_vec(ss, src).ok());
+
+    BitVec dst(1000);
+    ASSERT_TRUE(read_bit_vec(ss, dst).ok());
+    for (usize i = 0; i < src.size(); ++i) {
+        EXPECT_EQ(dst[i], src[i]);
+    }
+
+    // Size mismatch.
+    //
+    ss.seekg(0);
+    BitVec wrong_size(999);
+    EXPECT_FALSE(read_bit_vec(ss, wrong_size).ok());
+}
+
+}  // namespace
@@ -1,18 +1,28 @@
 #pragma once
 
 #include "bit_vec.hpp"
+#include "check_policy.hpp"
+#include "hash_fn.hpp"
 #include "imports.hpp"
+#include "parallel.hpp"
+#include "snapshot.hpp"
 #include "util.hpp"
 
 #include <batteries/strong_typedef.hpp>
 
-#include <xxhash.h>
-
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <bitset>
 #include <functional>
+#include <istream>
+#include <limits>
 #include <memory>
+#include <ostream>
 #include <random>
 #include <string_view>
+#include <utility>
+#include <vector>
 
 namespace tiny_pointers {
 
@@ -49,6 +59,11 @@ BATT_STRONG_TYPEDEF(usize, BitsPerSlot);
  */
 BATT_STRONG_TYPEDEF(double, Delta);
 
+/** \brief Groups related keys (e.g., the children of a tree node) so that they
+ * are allocated near each other in the store; usually the hash of a parent key.
+ */
+BATT_STRONG_TYPEDEF(u64, LocalityHint);
+
 //=#=#==#==#===============+=+=+=+=++=++++++++++++++-++-+--+-+----+---------------
 
 /** \brief Definition of load factor.
@@ -60,22 +75,92 @@ inline Delta load_factor(Delta delta) noexcept
 
 //=#=#==#==#===============+=+=+=+=++=++++++++++++++-++-+--+-+----+---------------
 
-/** \brief Define a family of seed-able hash functions for the various
- * constructions.
+/** \brief The memory used by a dereference table, and how it compares to
+ * storing a full-size pointer per entry (see DereferenceTable::footprint).
  */
-struct HashFn {
-    u64 seed_;
+struct MemoryFootprint {
+    // The size of the pointer that a tiny pointer replaces.
+    //
+    static constexpr usize kFullPointerBits = 64;
+
+    // The store: the slots holding values.
+    //
+    usize storage_bytes = 0;
+
+    // Everything else the table allocates: bucket free lists and high-water
+    // marks, occupancy bits, hash secrets, version counters, etc.
+    //
+    usize metadata_bytes = 0;
 
-    explicit HashFn(u64 seed) noexcept : seed_{seed}
+    // The number of active allocations.
+    //
+    usize live_entries = 0;
+
+    // The size of each tiny pointer, in bits; tiny pointers are held by the
+    // caller, not the table.
+    //
+    usize tiny_pointer_bits = 0;
+
+    usize total_bytes() const noexcept
     {
+        return this->storage_bytes + this->metadata_bytes;
     }
 
-    usize operator()(const std::string_view& s) const noexcept
+    /** \brief The table's memory (store and metadata) per active allocation.
+     */
+    double bytes_per_live_entry() const noexcept
     {
-        return XXH3_64bits_withSeed(s.data(), s.size(), this->seed_);
+        return (double)this->total_bytes() /
+               (double)std::max<usize>(1, this->live_entries);
+    }
+
+    /** \brief The table's metadata per active allocation; this is the overhead
+     * that a table of full-size pointers to separately allocated values would
+     * not have.
+     */
+    double metadata_bytes_per_live_entry() const noexcept
+    {
+        return (double)this->metadata_bytes /
+               (double)std::max<usize>(1, this->live_entries);
+    }
+
+    /** \brief The bits spent on tiny pointers for all active allocations.
+     */
+    usize tiny_pointer_total_bits() const noexcept
+    {
+        return this->live_entries * this->tiny_pointer_bits;
+    }
+
+    /** \brief The bits the same allocations would spend on full-size pointers.
+     */
+    usize full_pointer_total_bits() const noexcept
+    {
+        return this->live_entries * kFullPointerBits;
+    }
+
+    /** \brief The bytes saved by holding tiny pointers instead of full-size
+     * pointers, less the table's metadata (negative if the metadata costs more
+     * than the pointers save).
+     */
+    i64 net_bytes_saved() const noexcept
+    {
+        return ((i64)this->full_pointer_total_bits() -
+                (i64)this->tiny_pointer_total_bits()) /
+                   8 -
+               (i64)this->metadata_bytes;
     }
 };
 
+inline std::ostream& operator<<(std::ostream& out, const MemoryFootprint& t)
+{
+    return out << "MemoryFootprint{.storage_bytes=" << t.storage_bytes
+               << ", .metadata_bytes=" << t.metadata_bytes
+               << ", .live_entries=" << t.live_entries
+               << ", .tiny_pointer_bits=" << t.tiny_pointer_bits
+               << ", .bytes_per_live_entry=" << t.bytes_per_live_entry()
+               << ", .net_bytes_saved=" << t.net_bytes_saved() << ",}";
+}
+
 //=#=#==#==#===============+=+=+=+=++=++++++++++++++-++-+--+-+----+---------------
 
 /** \brief Dereference Table as defined in Section 2, Preliminaries.
@@ -126,6 +211,36 @@ class DereferenceTable
     //+++++++++++-+-+--+----- --- -- -  -  -   -
     // Additional methods:
 
+    /** \brief Like Allocate(`x`), but the location of the slot is derived from
+     * `hint` instead of `x`, so that keys allocated with the same hint land in
+     * the same bucket. The tiny pointer is only valid together with `hint`:
+     * callers must pass the same hint to Dereference and Free.
+     *
+     * The default implementation ignores `hint`.
+     */
+    virtual StatusOr<TinyPointer> Allocate(Key x, LocalityHint hint) noexcept
+    {
+        (void)hint;
+        return this->Allocate(x);
+    }
+
+    /** \brief Dereference for a tiny pointer returned by Allocate(`x`, `hint`).
+     */
+    virtual SlotIndex Dereference(Key x, LocalityHint hint,
+                                  TinyPointer p) noexcept
+    {
+        (void)hint;
+        return this->Dereference(x, std::move(p));
+    }
+
+    /** \brief Free for a tiny pointer returned by Allocate(`x`, `hint`).
+     */
+    virtual void Free(Key x, LocalityHint hint, TinyPointer p) noexcept
+    {
+        (void)hint;
+        this->Free(x, std::move(p));
+    }
+
     /** \brief Sets the value of slot `i` to `v`.
      */
     virtual void Set(SlotIndex i, Value v) noexcept = 0;
@@ -136,6 +251,16 @@ class DereferenceTable
      */
     virtual Value Get(SlotIndex i) noexcept = 0;
 
+    /** \brief Frees all slots at once; all previously returned tiny pointers
+     * become invalid. Runs in time proportional to the number of buckets, not
+     * the number of slots.
+     */
+    virtual void Clear() noexcept = 0;
+
+    /** \brief Returns the memory used by this table.
+     */
+    virtual MemoryFootprint footprint() const noexcept = 0;
+
     //+++++++++++-+-+--+----- --- -- -  -  -   -
    protected:
     DereferenceTable() = default;
@@ -152,20 +277,31 @@ class DereferenceTable
  *  2. has load factor 1 − `d`
  *  3. has constant-time operations
  *  4. produces tiny pointers of size O(log log `n`) bits
+ *
+ * `CheckPolicy` selects which hot-path assertions are compiled in (see
+ * check_policy.hpp).
  */
-class SimpleDereferenceTable : public DereferenceTable
+template <typename CheckPolicy = DefaultCheckPolicy>
+class BasicSimpleDereferenceTable : public DereferenceTable
 {
    public:
-    SimpleDereferenceTable(SlotCount n, BitsPerSlot q) noexcept
+    /** \brief Creates a table with (at least) `n` slots of `q` bits each.
+     * Keys are mapped to buckets by `hash_fn`; pass a fixed seed (or family)
+     * to make bucket assignments, and so allocation failures and benchmark
+     * results, reproducible.
+     */
+    BasicSimpleDereferenceTable(SlotCount n, BitsPerSlot q,
+                                HashFn hash_fn = HashFn::random()) noexcept
 
         // We partition the store into n/b buckets, each of which has b =
-        // log^4(n) slots.
+        // log^4(n) slots (see slots_per_bucket_for).
         //
-        : slots_per_bucket_{log2_ceil(n) * log2_ceil(n) * log2_ceil(n) *
-                            log2_ceil(n)}
+        : slots_per_bucket_(slots_per_bucket_for(n))
         , bucket_count_{(n + this->slots_per_bucket_ - 1) /
                         this->slots_per_bucket_}
+        , reduce_bucket_{this->bucket_count_}
         , n_slots_{this->slots_per_bucket_ * this->bucket_count_}
+        , requested_n_slots_{n}
         , log_n_{log2_ceil(this->n_slots_)}
 
         // If the key (x) is allocated the p-th slot in the bucket, then the
@@ -173,6 +309,11 @@ class SimpleDereferenceTable : public DereferenceTable
         //
         , p_bits_{log2_ceil(this->slots_per_bucket_)}
 
+        // Free list links and high-water marks range over [0, b]: one more
+        // value than a slot index, to mark the end of the list / a full bucket.
+        //
+        , link_bits_{log2_ceil(this->slots_per_bucket_ + 1)}
+
         // ...for q-bit values...
         //
         , q_bits_per_slot_{q}
@@ -182,25 +323,55 @@ class SimpleDereferenceTable : public DereferenceTable
         , delta_{1.0 / (double)this->log_n_}
 
         , size_{0}
-        , hash_fn_{std::random_device{}()}
+        , hash_fn_{std::move(hash_fn)}
         , storage_(this->n_slots_ * this->q_bits_per_slot_)
 
         // The head of the free list for each bucket.
         //
-        , free_list_head_(this->bucket_count_ * this->p_bits_)
+        , free_list_head_(this->bucket_count_ * this->link_bits_)
+
+        // The high-water mark for each bucket.
+        //
+        , free_list_init_(this->bucket_count_ * this->link_bits_)
+
+        // One bit per slot; set iff the slot is allocated.
+        //
+        , occupied_(this->n_slots_)
     {
         BATT_CHECK_GE(this->n_slots_, n);
         BATT_CHECK_GE(this->q_bits_per_slot_, this->log_n_);
+        BATT_CHECK_GE(this->q_bits_per_slot_, this->link_bits_);
 
-        // Initialize free lists; free heads should all be zero, so they are
-        // good.
-        //
-        for (usize bucket_i = 0; bucket_i < this->bucket_count_; ++bucket_i) {
-            for (usize slot_i = 0; slot_i < this->slots_per_bucket_; ++slot_i) {
-                this->set_free_next(bucket_i, slot_i,
-                                    BitVec{this->p_bits_, slot_i + 1});
-            }
-        }
+        // Free lists are initialized lazily: free heads and high-water marks
+        // should all be zero, so they are good (see get_free_next).
+    }
+
+    /** \brief b - the bucket size of a table created with `n` slots: log^4(n),
+     * or `n` if that is smaller (a table smaller than one bucket is a single
+     * bucket, so it isn't padded up to log^4(n) slots).
+     */
+    static usize slots_per_bucket_for(SlotCount n) noexcept
+    {
+        const usize log_n = log2_ceil(n);
+        return std::min<usize>(n, log_n * log_n * log_n * log_n);
+    }
+
+    /** \brief The number of slots (`n` rounded up to a whole number of buckets)
+     * of a table created with `n` slots.
+     */
+    static usize n_slots_for(SlotCount n) noexcept
+    {
+        const usize b = slots_per_bucket_for(n);
+        return (n + b - 1) / b * b;
+    }
+
+    /** \brief The smallest `q` accepted by the constructor for `n` slots: a
+     * slot must hold log(n) bits, and a free list link (see link_bits_).
+     */
+    static usize min_bits_per_slot(SlotCount n) noexcept
+    {
+        return std::max<usize>(log2_ceil(n_slots_for(n)),
+                               log2_ceil(slots_per_bucket_for(n) + 1));
     }
 
     /** \brief Returns the maximum fraction of storage slots available for
@@ -240,6 +411,13 @@ class SimpleDereferenceTable : public DereferenceTable
         return this->p_bits_;
     }
 
+    /** \brief q - the size of each slot, in bits.
+     */
+    usize bits_per_slot() const noexcept
+    {
+        return this->q_bits_per_slot_;
+    }
+
     usize slots_per_bucket() const noexcept
     {
         return this->slots_per_bucket_;
@@ -250,66 +428,182 @@ class SimpleDereferenceTable : public DereferenceTable
         return this->log_n_;
     }
 
+    /** \brief The hash function that maps keys to buckets.
+     */
+    const HashFn& hash_fn() const noexcept
+    {
+        return this->hash_fn_;
+    }
+
     usize bucket_count() const noexcept
     {
         return this->bucket_count_;
     }
 
+    /** \brief Returns true iff slot `i` is currently allocated.
+     */
+    bool is_allocated(SlotIndex i) const noexcept
+    {
+        const usize bucket_i = i / this->slots_per_bucket_;
+        const usize slot_i = i % this->slots_per_bucket_;
+
+        // Occupancy bits at or above the high-water mark are stale.
+        //
+        return slot_i < this->get_high_water(bucket_i) && this->occupied_[i];
+    }
+
+    /** \brief The number of active allocations in bucket `bucket_i`.
+     */
+    usize bucket_live_count(usize bucket_i) const noexcept
+    {
+        const usize begin = bucket_i * this->slots_per_bucket_;
+
+        return this->occupied_.count(begin,
+                                     begin + this->get_high_water(bucket_i));
+    }
+
+    /** \brief Invokes `fn(SlotIndex)` for each allocated slot in bucket
+     * `bucket_i`, in increasing slot order.
+     */
+    template <typename Fn>
+    void for_each_allocated_in_bucket(usize bucket_i, Fn&& fn) const
+    {
+        const usize begin = bucket_i * this->slots_per_bucket_;
+
+        this->occupied_.for_each_set_bit(
+            begin, begin + this->get_high_water(bucket_i), [&fn](usize i) {
+                fn(SlotIndex{i});
+            });
+    }
+
+    /** \brief Invokes `fn(SlotIndex)` for each allocated slot, in increasing
+     * slot order; runs in time proportional to n_slots() / 64 + size().
+     */
+    template <typename Fn>
+    void for_each_allocated(Fn&& fn) const
+    {
+        for (usize bucket_i = 0; bucket_i < this->bucket_count_; ++bucket_i) {
+            this->for_each_allocated_in_bucket(bucket_i, fn);
+        }
+    }
+
     //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
     //
     StatusOr<TinyPointer> Allocate(Key x) noexcept override
     {
         // Find the bucket for x.
         //
-        const usize bucket_i = this->find_bucket(x);
+        return this->allocate_in_bucket(this->find_bucket(x));
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    //
+    SlotIndex Dereference(Key x, TinyPointer p) noexcept override
+    {
+        // Find the bucket for x.
+        //
+        return this->slot_in_bucket(this->find_bucket(x), p);
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    //
+    void Free(Key x, TinyPointer p) noexcept override
+    {
+        // Find the bucket for x.
+        //
+        this->free_in_bucket(this->find_bucket(x), p);
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    // Locality hints: the bucket is chosen by the hint rather than by `x`, so
+    // all keys sharing a hint (and the key the hint was derived from, see
+    // locality_hint) share a bucket.
+
+    StatusOr<TinyPointer> Allocate(Key x, LocalityHint hint) noexcept override
+    {
+        (void)x;
+        return this->allocate_in_bucket(this->find_bucket(hint));
+    }
+
+    SlotIndex Dereference(Key x, LocalityHint hint,
+                          TinyPointer p) noexcept override
+    {
+        (void)x;
+        return this->slot_in_bucket(this->find_bucket(hint), p);
+    }
+
+    void Free(Key x, LocalityHint hint, TinyPointer p) noexcept override
+    {
+        (void)x;
+        this->free_in_bucket(this->find_bucket(hint), p);
+    }
+
+    /** \brief Returns a hint that places keys in the same bucket as `parent`.
+     */
+    LocalityHint locality_hint(const Key& parent) const noexcept
+    {
+        return LocalityHint{this->hash_fn_(parent)};
+    }
 
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    /** \brief Allocates a slot from the free list of bucket `bucket_i`.
+     */
+    StatusOr<TinyPointer> allocate_in_bucket(usize bucket_i) noexcept
+    {
         // Look at the first free slot for the bucket.
         //
-        TinyPointer free_slot = this->get_free_head(bucket_i);
-        if (free_slot.int_value() == this->slots_per_bucket_) {
+        const usize free_slot = this->get_free_head(bucket_i);
+        if (free_slot == (usize)this->slots_per_bucket_) {
             return {batt::StatusCode::kResourceExhausted};
         }
-        BATT_CHECK_LT(free_slot.int_value(), this->slots_per_bucket_);
+        TINY_POINTERS_CHECK_LT(CheckPolicy, free_slot, this->slots_per_bucket_);
 
         // There is a free slot; set the head of the free list to the next
         // free slot and give the first one to the caller.
         //
-        TinyPointer next_free =
-            this->get_free_next(bucket_i, free_slot.int_value());
+        const usize next_free = this->get_free_next(bucket_i, free_slot);
         this->set_free_head(bucket_i, next_free);
 
-        BATT_CHECK_EQ(this->get_free_head(bucket_i).int_value(),
-                      next_free.int_value());
+        // If this is the first time the slot has been allocated (since the
+        // last reset), raise the high-water mark past it.
+        //
+        const usize high_water = this->get_high_water(bucket_i);
+        TINY_POINTERS_CHECK_LE(CheckPolicy, free_slot, high_water);
+        if (free_slot == high_water) {
+            this->set_high_water(bucket_i, high_water + 1);
+        }
+
+        TINY_POINTERS_CHECK_EQ(CheckPolicy, this->get_free_head(bucket_i),
+                               next_free);
+
+        this->occupied_.set(bucket_i * this->slots_per_bucket_ + free_slot,
+                            true);
 
         // Success!
         //
         ++this->size_;
-        return free_slot;
+        return TinyPointer{this->p_bits_, free_slot};
     }
 
     //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
-    //
-    SlotIndex Dereference(Key x, TinyPointer p) noexcept override
+    /** \brief Returns the index of slot `p` within bucket `bucket_i`.
+     */
+    SlotIndex slot_in_bucket(usize bucket_i,
+                             const TinyPointer& p) const noexcept
     {
-        BATT_CHECK_EQ(p.size(), this->p_bits_);
+        TINY_POINTERS_CHECK_EQ(CheckPolicy, p.size(), this->p_bits_);
 
-        // Find the bucket for x.
-        //
-        const usize bucket_i = this->find_bucket(x);
         const usize slot_i = p.int_value();
 
         return SlotIndex{bucket_i * this->slots_per_bucket_ + slot_i};
     }
 
     //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
-    //
-    void Free(Key x, TinyPointer p) noexcept override
+    /** \brief Returns slot `p` to the free list of bucket `bucket_i`.
+     */
+    void free_in_bucket(usize bucket_i, const TinyPointer& p) noexcept
     {
-        BATT_CHECK_EQ(p.size(), this->p_bits_);
-
-        // Find the bucket for x.
-        //
-        const usize bucket_i = this->find_bucket(x);
+        TINY_POINTERS_CHECK_EQ(CheckPolicy, p.size(), this->p_bits_);
 
         // Slot `p` will be the new head; set it's next to the current head.
         //
@@ -318,7 +612,10 @@ class SimpleDereferenceTable : public DereferenceTable
 
         // Push `p` onto the free list.
         //
-        this->set_free_head(bucket_i, p);
+        this->set_free_head(bucket_i, p.int_value());
+
+        this->occupied_.set(bucket_i * this->slots_per_bucket_ + p.int_value(),
+                            false);
 
         // Success!
         //
@@ -329,66 +626,485 @@ class SimpleDereferenceTable : public DereferenceTable
     //
     void Set(SlotIndex i, Value v) noexcept override
     {
-        BATT_CHECK_LE(v.size(), this->q_bits_per_slot_);
+        TINY_POINTERS_CHECK_LE(CheckPolicy, v.size(),
+                               this->q_bits_per_slot_);
 
         const usize pos = i * this->q_bits_per_slot_;
 
-        this->storage_.set_range(pos, v);
+        // Relaxed atomic stores (see load_slot).
+        //
+        this->storage_.set_range_relaxed(pos, v);
     }
 
     //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
     //
     Value Get(SlotIndex i) noexcept override
+    {
+        return std::as_const(*this).Get(i);
+    }
+
+    /** \brief Gets the value currently held by slot `i` (see Get).
+     */
+    Value Get(SlotIndex i) const noexcept
     {
         const usize pos = i * this->q_bits_per_slot_;
 
         return this->storage_.get_range(pos, pos + this->q_bits_per_slot_);
     }
 
+    /** \brief Copies the value of slot `i` into `out`, which must be
+     * bits_per_slot() bits, using relaxed atomic loads.
+     *
+     * Set and the free list links store slot words atomically too, so this
+     * may run concurrently with a single writer thread without a data race;
+     * the caller must still detect a torn value (see
+     * SeqLockDereferenceTable).  Doesn't allocate.
+     */
+    void load_slot(SlotIndex i, Value& out) const noexcept
+    {
+        TINY_POINTERS_CHECK_EQ(CheckPolicy, out.size(), this->q_bits_per_slot_);
+
+        const usize pos = i * this->q_bits_per_slot_;
+
+        this->storage_.load_range_relaxed(pos, out);
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    //
+    void Clear() noexcept override
+    {
+        // Resetting the free head and high-water mark of a bucket turns all of
+        // its slots back into the implicit (never allocated) free list.
+        //
+        for (usize bucket_i = 0; bucket_i < this->bucket_count_; ++bucket_i) {
+            this->reset_bucket(bucket_i);
+        }
+        this->size_ = 0;
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    //
+    MemoryFootprint footprint() const noexcept override
+    {
+        return MemoryFootprint{
+            .storage_bytes = this->storage_.byte_size(),
+            .metadata_bytes = sizeof(*this) +
+                              this->free_list_head_.byte_size() +
+                              this->free_list_init_.byte_size() +
+                              this->occupied_.byte_size(),
+            .live_entries = this->size_,
+            .tiny_pointer_bits = (usize)this->p_bits_,
+        };
+    }
+
+    /** \brief Frees all slots in bucket `bucket_i` at once; tiny pointers into
+     * other buckets remain valid.
+     */
+    void FreeBucket(usize bucket_i) noexcept
+    {
+        this->size_ -= this->bucket_live_count(bucket_i);
+        this->reset_bucket(bucket_i);
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    /** \brief Returns Dereference(`keys[i]`, `ptrs[i]`) for each `i`, in input
+     * order.
+     *
+     * Keys are hashed a chunk at a time with HashFn::hash_batch, so that the
+     * hashes of neighbouring keys overlap rather than run one after another.
+     */
+    template <typename KeyRange>
+    std::vector<SlotIndex> BulkDereference(
+        const KeyRange& keys, const std::vector<TinyPointer>& ptrs) const
+    {
+        BATT_CHECK_EQ(keys.size(), ptrs.size());
+
+        const usize n_keys = keys.size();
+        std::vector<SlotIndex> slots;
+        slots.reserve(n_keys);
+
+        constexpr usize kChunkSize = 256;
+        u64 hashes[kChunkSize];
+
+        for (usize chunk = 0; chunk < n_keys; chunk += kChunkSize) {
+            const usize chunk_end = std::min(n_keys, chunk + kChunkSize);
+            this->hash_fn_.hash_batch(keys, chunk, chunk_end, hashes);
+
+            for (usize key_i = chunk; key_i < chunk_end; ++key_i) {
+                slots.push_back(this->slot_in_bucket(
+                    this->find_bucket(LocalityHint{hashes[key_i - chunk]}),
+                    ptrs[key_i]));
+            }
+        }
+        return slots;
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    /** \brief Allocates a slot to each of `keys` using `n_threads` threads
+     * (0 means one per core); returns the tiny pointers in input order.
+     *
+     * The result is identical to calling Allocate on each key in order, but:
+     *
+     *  1. keys are hashed in parallel and radix-partitioned by bucket;
+     *  2. each thread then walks the free lists of a contiguous range of
+     *     buckets, assigning slots to that bucket's keys;
+     *  3. finally each thread updates the bucket metadata of its range; the
+     *     few buckets whose bit-packed metadata shares a word with another
+     *     range are updated serially afterwards.
+     *
+     * If any bucket would overflow, returns kResourceExhausted and leaves the
+     * table unchanged.
+     */
+    template <typename KeyRange>
+    StatusOr<std::vector<TinyPointer>> BulkAllocate(const KeyRange& keys,
+                                                    usize n_threads = 0)
+    {
+        const usize n_keys = keys.size();
+        const usize n_buckets = this->bucket_count_;
+
+        BATT_CHECK_LE(n_buckets, std::numeric_limits<u32>::max());
+
+        n_threads = std::max<usize>(
+            1, std::min(default_thread_count(n_threads), n_keys));
+
+        // Phase 1: hash the keys and count them per (thread, bucket).
+        //
+        std::vector<u32> key_bucket(n_keys);
+        std::vector<usize> offsets(n_threads * n_buckets, 0);
+
+        run_parallel(n_threads, [&](usize thread_i) {
+            const auto [begin, end] = split_range(n_keys, n_threads, thread_i);
+            usize* const counts = offsets.data() + thread_i * n_buckets;
+
+            constexpr usize kChunkSize = 256;
+            u64 hashes[kChunkSize];
+
+            for (usize chunk = begin; chunk < end; chunk += kChunkSize) {
+                const usize chunk_end = std::min(end, chunk + kChunkSize);
+                this->hash_fn_.hash_batch(keys, chunk, chunk_end, hashes);
+
+                for (usize key_i = chunk; key_i < chunk_end; ++key_i) {
+                    const u32 bucket_i = this->find_bucket(
+                        LocalityHint{hashes[key_i - chunk]});
+                    key_bucket[key_i] = bucket_i;
+                    ++counts[bucket_i];
+                }
+            }
+        });
+
+        // Turn the counts into scatter offsets, bucket-major, so each bucket's
+        // keys are contiguous and stay in input order.
+        //
+        std::vector<usize> bucket_begin(n_buckets + 1);
+        {
+            usize total = 0;
+            for (usize bucket_i = 0; bucket_i < n_buckets; ++bucket_i) {
+                bucket_begin[bucket_i] = total;
+                for (usize thread_i = 0; thread_i < n_threads; ++thread_i) {
+                    usize& offset = offsets[thread_i * n_buckets + bucket_i];
+                    const usize count = offset;
+                    offset = total;
+                    total += count;
+                }
+            }
+            bucket_begin[n_buckets] = total;
+        }
+
+        // Scatter the key indices into bucket order.
+        //
+        std::vector<usize> order(n_keys);
+
+        run_parallel(n_threads, [&](usize thread_i) {
+            const auto [begin, end] = split_range(n_keys, n_threads, thread_i);
+            usize* const next = offsets.data() + thread_i * n_buckets;
+
+            for (usize key_i = begin; key_i < end; ++key_i) {
+                order[next[key_bucket[key_i]]++] = key_i;
+            }
+        });
+
+        // Phase 2: walk each bucket's free list (read-only) to assign slots.
+        //
+        struct BucketUpdate {
+            usize free_head;
+            usize high_water;
+        };
+
+        const usize n_fill_threads = std::min(n_threads, n_buckets);
+        std::vector<BucketUpdate> updates(n_buckets);
+        std::vector<TinyPointer> ptrs(n_keys);
+        std::atomic<bool> overflow{false};
+
+        run_parallel(n_fill_threads, [&](usize thread_i) {
+            const auto [first_bucket, last_bucket] =
+                split_range(n_buckets, n_fill_threads, thread_i);
+
+            for (usize bucket_i = first_bucket; bucket_i < last_bucket;
+                 ++bucket_i) {
+                const usize begin = bucket_begin[bucket_i];
+                const usize end = bucket_begin[bucket_i + 1];
+
+                if (end - begin > this->slots_per_bucket_ -
+                                      this->bucket_live_count(bucket_i)) {
+                    overflow.store(true, std::memory_order_relaxed);
+                    return;
+                }
+
+                usize free_head = this->get_free_head(bucket_i);
+                usize high_water = this->get_high_water(bucket_i);
+
+                for (usize k = begin; k < end; ++k) {
+                    TINY_POINTERS_CHECK_LT(CheckPolicy, free_head,
+                                           this->slots_per_bucket_);
+
+                    ptrs[order[k]] = TinyPointer{this->p_bits_, free_head};
+                    high_water = std::max(high_water, free_head + 1);
+
+                    free_head = this->get_free_next(bucket_i, free_head);
+                }
+                updates[bucket_i] = BucketUpdate{free_head, high_water};
+            }
+        });
+
+        if (overflow.load()) {
+            return {batt::StatusCode::kResourceExhausted};
+        }
+
+        // Phase 3: commit, over the same bucket ranges as phase 2.
+        //
+        const auto commit_bucket = [&](usize bucket_i) {
+            this->set_free_head(bucket_i, updates[bucket_i].free_head);
+            this->set_high_water(bucket_i, updates[bucket_i].high_water);
+
+            const usize first_slot = bucket_i * this->slots_per_bucket_;
+            for (usize k = bucket_begin[bucket_i];
+                 k < bucket_begin[bucket_i + 1]; ++k) {
+                this->occupied_.set(first_slot + ptrs[order[k]].int_value(),
+                                    true);
+            }
+        };
+
+        // The free heads, high-water marks, and occupancy bits are packed
+        // across buckets, so the buckets at either end of a range may share a
+        // word with the neighbouring range; those are committed afterwards.
+        //
+        const auto shares_word_outside = [n_buckets](usize bucket_i,
+                                                     usize first_bucket,
+                                                     usize last_bucket,
+                                                     usize bits) {
+            const usize range_begin = first_bucket * bits;
+            const usize range_end = last_bucket * bits;
+
+            return (first_bucket > 0 && range_begin % 64 != 0 &&
+                    bucket_i * bits / 64 == range_begin / 64) ||
+                   (last_bucket < n_buckets && range_end % 64 != 0 &&
+                    ((bucket_i + 1) * bits - 1) / 64 == (range_end - 1) / 64);
+        };
+
+        std::vector<std::vector<usize>> deferred(n_fill_threads);
+
+        run_parallel(n_fill_threads, [&](usize thread_i) {
+            const auto [first_bucket, last_bucket] =
+                split_range(n_buckets, n_fill_threads, thread_i);
+
+            for (usize bucket_i = first_bucket; bucket_i < last_bucket;
+                 ++bucket_i) {
+                if (bucket_begin[bucket_i] == bucket_begin[bucket_i + 1]) {
+                    continue;
+                }
+                if (shares_word_outside(bucket_i, first_bucket, last_bucket,
+                                        this->link_bits_) ||
+                    shares_word_outside(bucket_i, first_bucket, last_bucket,
+                                        this->slots_per_bucket_)) {
+                    deferred[thread_i].push_back(bucket_i);
+                    continue;
+                }
+                commit_bucket(bucket_i);
+            }
+        });
+
+        for (const std::vector<usize>& buckets : deferred) {
+            for (usize bucket_i : buckets) {
+                commit_bucket(bucket_i);
+            }
+        }
+        this->size_ += n_keys;
+
+        return ptrs;
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    /** \brief Writes a snapshot of this table (header, then bucket metadata,
+     * then the store) to `out`. The bit vectors are streamed word-for-word,
+     * without an intermediate copy.
+     */
+    Status save(std::ostream& out) const
+    {
+        BATT_REQUIRE_OK(write_snapshot_header(
+            out, SnapshotHeader{
+                     .layout = SnapshotLayout::kSimple,
+                     .hash_family = this->hash_fn_.family(),
+                     .n = this->requested_n_slots_,
+                     .q = this->q_bits_per_slot_,
+                     .p_bits = (u64)this->p_bits_,
+                     .seed = this->hash_fn_.seed(),
+                     .delta = this->delta_,
+                     .size = this->size_,
+                 }));
+
+        BATT_REQUIRE_OK(write_bit_vec(out, this->free_list_head_));
+        BATT_REQUIRE_OK(write_bit_vec(out, this->free_list_init_));
+        BATT_REQUIRE_OK(write_bit_vec(out, this->occupied_));
+
+        return write_bit_vec(out, this->storage_);
+    }
+
+    /** \brief Reads a table written by save; tiny pointers returned by the
+     * saved table are valid for the loaded one. If the table used a custom hash
+     * function, the same function must be passed as `custom_fn` (otherwise,
+     * returns kInvalidArgument).
+     */
+    static StatusOr<std::unique_ptr<BasicSimpleDereferenceTable>> load(
+        std::istream& in, const HashFn::CustomFn& custom_fn = nullptr)
+    {
+        BATT_ASSIGN_OK_RESULT(
+            const SnapshotHeader header,
+            read_snapshot_header(in, SnapshotLayout::kSimple));
+
+        // Validate the geometry the constructor would derive from the header
+        // before constructing anything (the constructor panics on bad input).
+        //
+        if (header.n < 2 || header.n > kMaxSnapshotSlots) {
+            return {batt::StatusCode::kDataLoss};
+        }
+        const SlotCount n{header.n};
+        const usize n_slots = n_slots_for(n);
+        if (!snapshot_geometry_ok(header.n, n_slots, header.q) ||
+            header.q < min_bits_per_slot(n) || header.size > n_slots) {
+            return {batt::StatusCode::kDataLoss};
+        }
+
+        BATT_ASSIGN_OK_RESULT(
+            HashFn hash_fn,
+            HashFn::restore(header.hash_family, header.seed, custom_fn));
+
+        auto table = std::make_unique<BasicSimpleDereferenceTable>(
+            n, BitsPerSlot{header.q}, std::move(hash_fn));
+
+        if ((u64)table->p_bits_ != header.p_bits) {
+            return {batt::StatusCode::kDataLoss};
+        }
+
+        table->size_ = header.size;
+
+        BATT_REQUIRE_OK(read_bit_vec(in, table->free_list_head_));
+        BATT_REQUIRE_OK(read_bit_vec(in, table->free_list_init_));
+        BATT_REQUIRE_OK(read_bit_vec(in, table->occupied_));
+        BATT_REQUIRE_OK(read_bit_vec(in, table->storage_));
+
+        // The bucket metadata must be in range, and agree with the header.
+        // Occupancy bits at or above a bucket's high-water mark are stale
+        // (Clear and FreeBucket leave them set), so only those below it count.
+        //
+        usize live = 0;
+        for (usize bucket_i = 0; bucket_i < table->bucket_count_; ++bucket_i) {
+            const usize b = table->slots_per_bucket_;
+            if (table->get_free_head(bucket_i) > b ||
+                table->get_high_water(bucket_i) > b) {
+                return {batt::StatusCode::kDataLoss};
+            }
+            live += table->bucket_live_count(bucket_i);
+        }
+        if (live != table->size_) {
+            return {batt::StatusCode::kDataLoss};
+        }
+
+        return table;
+    }
+
     //+++++++++++-+-+--+----- --- -- -  -  -   -
     // public for TESTING ONLY!
     //
     usize find_bucket(const Key& x) const noexcept
     {
-        const u64 bucket_i = scale_u64(this->hash_fn_(x), this->bucket_count_);
-        BATT_CHECK_LT(bucket_i, this->bucket_count_);
+        return this->find_bucket(LocalityHint{this->hash_fn_(x)});
+    }
+
+    usize find_bucket(LocalityHint hint) const noexcept
+    {
+        const u64 bucket_i = this->reduce_bucket_(hint);
+        TINY_POINTERS_CHECK_LT(CheckPolicy, bucket_i, this->bucket_count_);
 
         return bucket_i;
     }
 
-    void set_free_next(usize bucket_i, usize slot_i,
-                       const TinyPointer& value) noexcept
+    void set_free_next(usize bucket_i, usize slot_i, usize value) noexcept
     {
-        BATT_CHECK_EQ(value.size(), this->p_bits_);
+        TINY_POINTERS_CHECK_LE(CheckPolicy, value, this->slots_per_bucket_);
 
         const usize pos = (bucket_i * this->slots_per_bucket_ + slot_i) *
                           this->q_bits_per_slot_;
 
-        this->storage_.set_range(pos, value);
+        this->storage_.set_range_relaxed(pos,
+                                         BitVec{(usize)this->link_bits_, value});
     }
 
-    TinyPointer get_free_next(usize bucket_i, usize slot_i) const noexcept
+    usize get_free_next(usize bucket_i, usize slot_i) const noexcept
     {
+        // Slots at or above the high-water mark haven't been allocated since
+        // the last reset; their free list links are implicit.
+        //
+        if (slot_i >= this->get_high_water(bucket_i)) {
+            return slot_i + 1;
+        }
+
         const usize pos = (bucket_i * this->slots_per_bucket_ + slot_i) *
                           this->q_bits_per_slot_;
 
-        return this->storage_.get_range(pos, pos + this->p_bits_);
+        return this->storage_.get_range(pos, pos + this->link_bits_)
+            .int_value();
+    }
+
+    void set_free_head(usize bucket_i, usize value) noexcept
+    {
+        TINY_POINTERS_CHECK_LE(CheckPolicy, value, this->slots_per_bucket_);
+
+        const usize pos = bucket_i * this->link_bits_;
+
+        this->free_list_head_.set_range(pos,
+                                        BitVec{(usize)this->link_bits_, value});
+    }
+
+    usize get_free_head(usize bucket_i) const noexcept
+    {
+        const usize pos = bucket_i * this->link_bits_;
+
+        return this->free_list_head_.get_range(pos, pos + this->link_bits_)
+            .int_value();
     }
 
-    void set_free_head(usize bucket_i, const TinyPointer& value) noexcept
+    void set_high_water(usize bucket_i, usize value) noexcept
     {
-        BATT_CHECK_EQ(value.size(), this->p_bits_);
+        TINY_POINTERS_CHECK_LE(CheckPolicy, value, this->slots_per_bucket_);
 
-        const usize pos = bucket_i * this->p_bits_;
+        const usize pos = bucket_i * this->link_bits_;
 
-        this->free_list_head_.set_range(pos, value);
+        this->free_list_init_.set_range(pos,
+                                        BitVec{(usize)this->link_bits_, value});
     }
 
-    TinyPointer get_free_head(usize bucket_i) const noexcept
+    usize get_high_water(usize bucket_i) const noexcept
     {
-        const usize pos = bucket_i * this->p_bits_;
+        const usize pos = bucket_i * this->link_bits_;
 
-        return this->free_list_head_.get_range(pos, pos + this->p_bits_);
+        return this->free_list_init_.get_range(pos, pos + this->link_bits_)
+            .int_value();
+    }
+
+    void reset_bucket(usize bucket_i) noexcept
+    {
+        this->set_free_head(bucket_i, 0);
+        this->set_high_water(bucket_i, 0);
     }
     //
     //+++++++++++-+-+--+----- --- -- -  -  -   -
@@ -403,10 +1119,19 @@ class SimpleDereferenceTable : public DereferenceTable
     //
     const usize bucket_count_;
 
+    // Maps a hash value to a bucket index (see find_bucket).
+    //
+    const BucketReducer reduce_bucket_;
+
     // n - the number of slots
     //
     const SlotCount n_slots_;
 
+    // n, as passed to the constructor (n_slots_ is rounded up to a whole number
+    // of buckets); recorded in snapshots to recompute the same geometry.
+    //
+    const SlotCount requested_n_slots_;
+
     // log(n)
     //
     const i32 log_n_;
@@ -415,6 +1140,11 @@ class SimpleDereferenceTable : public DereferenceTable
     //
     const i32 p_bits_;
 
+    // The size of free list links, free list heads, and high-water marks, in
+    // bits: log(b + 1), since they can hold b (see the constructor).
+    //
+    const i32 link_bits_;
+
     // q - the value size
     //
     const BitsPerSlot q_bits_per_slot_;
@@ -429,6 +1159,21 @@ class SimpleDereferenceTable : public DereferenceTable
     HashFn hash_fn_;
     BitVec storage_;
     BitVec free_list_head_;
+
+    // Slots [0, high-water) of a bucket have been allocated at least once
+    // since the last reset; the rest form an implicit free list (slot i links
+    // to i + 1), which makes Clear() O(buckets) instead of O(n).
+    //
+    BitVec free_list_init_;
+
+    // Occupancy bitmap (the free lists are threaded through storage_, so they
+    // can't be told apart from data).
+    //
+    BitVec occupied_;
 };
 
+/** \brief A SimpleDereferenceTable using the build's DefaultCheckPolicy.
+ */
+using SimpleDereferenceTable = BasicSimpleDereferenceTable<>;
+
 }  //namespace tiny_pointers
@@ -7,19 +7,32 @@
 
 #include <tiny_pointers/data.hpp>
 
+#include <algorithm>
 #include <bitset>
+#include <chrono>
 #include <cmath>
+#include <cstring>
 #include <random>
+#include <sstream>
+#include <unordered_set>
 
 namespace {
 
 using namespace batt::int_types;
+using tiny_pointers::BasicSimpleDereferenceTable;
 using tiny_pointers::BitsPerSlot;
 using tiny_pointers::BitVec;
+using tiny_pointers::HashFamily;
+using tiny_pointers::HashFn;
+using tiny_pointers::FullChecks;
 using tiny_pointers::Key;
+using tiny_pointers::LocalityHint;
+using tiny_pointers::MemoryFootprint;
+using tiny_pointers::NoChecks;
 using tiny_pointers::random_key;
 using tiny_pointers::SimpleDereferenceTable;
 using tiny_pointers::SlotCount;
+using tiny_pointers::SlotIndex;
 using tiny_pointers::Status;
 using tiny_pointers::StatusOr;
 using tiny_pointers::TinyPointer;
@@ -64,10 +77,9 @@ TEST(TinyPointersTest, SimpleDereferenceTable_LoadFactor)
         load_factor = sdt.load_factor();
 
         for (usize j = 0; j < sdt.bucket_count(); ++j) {
-            BitVec head = sdt.get_free_head(j);
-            ASSERT_EQ(head.int_value(), 0);
+            ASSERT_EQ(sdt.get_free_head(j), 0);
             for (usize s = 0; s < sdt.slots_per_bucket(); ++s) {
-                ASSERT_EQ(sdt.get_free_next(j, s).int_value(), s + 1);
+                ASSERT_EQ(sdt.get_free_next(j, s), s + 1);
             }
         }
 
@@ -93,4 +105,774 @@ TEST(TinyPointersTest, SimpleDereferenceTable_LoadFactor)
     EXPECT_GT(p50, capacity);
 }
 
+//==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+//
+TEST(TinyPointersTest, SimpleDereferenceTable_LocalityHint)
+{
+    SimpleDereferenceTable sdt{SlotCount{100000}, BitsPerSlot{64}};
+
+    ASSERT_GT(sdt.bucket_count(), 1);
+
+    std::default_random_engine rng{std::random_device{}()};
+
+    for (usize i = 0; i < 100; ++i) {
+        const std::string parent = random_key(rng);
+        const LocalityHint hint = sdt.locality_hint(parent);
+
+        StatusOr<TinyPointer> parent_p = sdt.Allocate(parent);
+        ASSERT_TRUE(parent_p.ok());
+
+        const usize parent_bucket =
+            sdt.Dereference(parent, *parent_p) / sdt.slots_per_bucket();
+
+        std::vector<std::string> children;
+        std::vector<TinyPointer> child_ps;
+        for (usize j = 0; j < 4; ++j) {
+            children.emplace_back(parent + ":" + std::to_string(j));
+
+            StatusOr<TinyPointer> p = sdt.Allocate(children.back(), hint);
+            ASSERT_TRUE(p.ok());
+
+            const SlotIndex slot = sdt.Dereference(children.back(), hint, *p);
+            EXPECT_EQ(slot / sdt.slots_per_bucket(), parent_bucket);
+
+            sdt.Set(slot, BitVec{64, j});
+            child_ps.emplace_back(std::move(*p));
+        }
+        for (usize j = 0; j < children.size(); ++j) {
+            EXPECT_EQ(
+                sdt.Get(sdt.Dereference(children[j], hint, child_ps[j]))
+                    .int_value(),
+                j);
+            sdt.Free(children[j], hint, child_ps[j]);
+        }
+        sdt.Free(parent, *parent_p);
+    }
+
+    EXPECT_EQ(sdt.size(), 0);
+}
+
+//==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+//
+TEST(TinyPointersTest, SimpleDereferenceTable_ForEachAllocated)
+{
+    SimpleDereferenceTable sdt{SlotCount{100000}, BitsPerSlot{64}};
+
+    std::default_random_engine rng{std::random_device{}()};
+
+    std::vector<std::string> keys;
+    std::vector<TinyPointer> ptrs;
+    for (usize i = 0; i < 5000; ++i) {
+        keys.emplace_back(random_key(rng));
+        StatusOr<TinyPointer> p = sdt.Allocate(keys.back());
+        ASSERT_TRUE(p.ok());
+        ptrs.emplace_back(std::move(*p));
+    }
+    for (usize i = 0; i < keys.size(); i += 3) {
+        sdt.Free(keys[i], ptrs[i]);
+    }
+
+    std::vector<usize> expected;
+    for (usize i = 0; i < keys.size(); ++i) {
+        const SlotIndex slot = sdt.Dereference(keys[i], ptrs[i]);
+        EXPECT_EQ(sdt.is_allocated(slot), i % 3 != 0);
+        if (i % 3 != 0) {
+            expected.push_back(slot);
+        }
+    }
+    std::sort(expected.begin(), expected.end());
+
+    std::vector<usize> actual;
+    sdt.for_each_allocated([&actual](SlotIndex i) {
+        actual.push_back(i);
+    });
+    EXPECT_EQ(actual, expected);
+
+    usize total = 0;
+    for (usize j = 0; j < sdt.bucket_count(); ++j) {
+        usize in_bucket = 0;
+        sdt.for_each_allocated_in_bucket(j, [&](SlotIndex i) {
+            EXPECT_EQ(i / sdt.slots_per_bucket(), j);
+            ++in_bucket;
+        });
+        EXPECT_EQ(in_bucket, sdt.bucket_live_count(j));
+        total += sdt.bucket_live_count(j);
+    }
+    EXPECT_EQ(total, sdt.size());
+}
+
+//==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+//
+TEST(TinyPointersTest, SimpleDereferenceTable_ClearAndFreeBucket)
+{
+    SimpleDereferenceTable sdt{SlotCount{100000}, BitsPerSlot{64}};
+
+    ASSERT_GT(sdt.bucket_count(), 1);
+
+    std::default_random_engine rng{std::random_device{}()};
+
+    for (usize round = 0; round < 3; ++round) {
+        std::vector<std::string> keys;
+        std::vector<TinyPointer> ptrs;
+        for (usize i = 0; i < 20000; ++i) {
+            keys.emplace_back(random_key(rng));
+            StatusOr<TinyPointer> p = sdt.Allocate(keys.back());
+            ASSERT_TRUE(p.ok());
+            sdt.Set(sdt.Dereference(keys.back(), *p), BitVec{64, i});
+            ptrs.emplace_back(std::move(*p));
+        }
+        EXPECT_EQ(sdt.size(), keys.size());
+
+        // Free everything in bucket 0; keys in the other buckets keep their
+        // slots and values.
+        //
+        const usize freed = sdt.bucket_live_count(0);
+        sdt.FreeBucket(0);
+
+        EXPECT_EQ(sdt.bucket_live_count(0), 0);
+        EXPECT_EQ(sdt.size(), keys.size() - freed);
+
+        for (usize i = 0; i < keys.size(); ++i) {
+            const SlotIndex slot = sdt.Dereference(keys[i], ptrs[i]);
+            if (sdt.find_bucket(keys[i]) == 0) {
+                EXPECT_FALSE(sdt.is_allocated(slot));
+            } else {
+                EXPECT_TRUE(sdt.is_allocated(slot));
+                EXPECT_EQ(sdt.Get(slot).int_value(), i);
+            }
+        }
+
+        sdt.Clear();
+
+        EXPECT_EQ(sdt.size(), 0);
+        for (usize j = 0; j < sdt.bucket_count(); ++j) {
+            EXPECT_EQ(sdt.bucket_live_count(j), 0);
+            EXPECT_EQ(sdt.get_free_head(j), 0);
+        }
+        sdt.for_each_allocated([](SlotIndex) {
+            ADD_FAILURE();
+        });
+    }
+}
+
+//==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+//
+TEST(TinyPointersTest, SimpleDereferenceTable_FullPowerOfTwoBucket)
+{
+    // Each of these is a single bucket whose size is a power of two, so the
+    // free list end / high-water mark (b) needs one more bit than a slot
+    // index.
+    //
+    for (usize n : {16, 256, 4096}) {
+        SimpleDereferenceTable sdt{SlotCount{n}, BitsPerSlot{64}};
+
+        ASSERT_EQ(sdt.bucket_count(), 1u);
+        ASSERT_EQ(sdt.slots_per_bucket(), n);
+
+        for (int round = 0; round < 2; ++round) {
+            for (usize i = 0; i < n; ++i) {
+                ASSERT_TRUE(sdt.Allocate(std::to_string(i)).ok())
+                    << BATT_INSPECT(n) << BATT_INSPECT(i);
+            }
+            EXPECT_EQ(sdt.Allocate("one too many").status(),
+                      batt::StatusCode::kResourceExhausted);
+
+            EXPECT_EQ(sdt.size(), n);
+            EXPECT_EQ(sdt.bucket_live_count(0), n);
+            usize visited = 0;
+            sdt.for_each_allocated([&](SlotIndex i) {
+                EXPECT_TRUE(sdt.is_allocated(i));
+                ++visited;
+            });
+            EXPECT_EQ(visited, n);
+
+            sdt.FreeBucket(0);
+
+            EXPECT_EQ(sdt.size(), 0u);
+            EXPECT_EQ(sdt.bucket_live_count(0), 0u);
+        }
+
+        // Freeing the last slot of a full bucket and allocating again reuses
+        // it, and the bucket is full again afterwards.
+        //
+        std::vector<TinyPointer> ptrs;
+        for (usize i = 0; i < n; ++i) {
+            ptrs.emplace_back(*sdt.Allocate(std::to_string(i)));
+        }
+        sdt.Free(std::to_string(n - 1), ptrs[n - 1]);
+        StatusOr<TinyPointer> p = sdt.Allocate("again");
+        ASSERT_TRUE(p.ok());
+        EXPECT_EQ(p->int_value(), ptrs[n - 1].int_value());
+        EXPECT_FALSE(sdt.Allocate("one too many").ok());
+    }
+}
+
+//==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+//
+TEST(TinyPointersTest, SimpleDereferenceTable_Snapshot)
+{
+    SimpleDereferenceTable sdt{SlotCount{100000}, BitsPerSlot{64}};
+
+    std::default_random_engine rng{std::random_device{}()};
+
+    std::vector<std::string> keys;
+    std::vector<TinyPointer> ptrs;
+    for (usize i = 0; i < 10000; ++i) {
+        keys.emplace_back(random_key(rng));
+        StatusOr<TinyPointer> p = sdt.Allocate(keys.back());
+        ASSERT_TRUE(p.ok());
+        sdt.Set(sdt.Dereference(keys.back(), *p), BitVec{64, i});
+        ptrs.emplace_back(std::move(*p));
+    }
+    for (usize i = 0; i < keys.size(); i += 2) {
+        sdt.Free(keys[i], ptrs[i]);
+    }
+
+    std::stringstream ss;
+    ASSERT_TRUE(sdt.save(ss).ok());
+
+    StatusOr<std::unique_ptr<SimpleDereferenceTable>> loaded =
+        SimpleDereferenceTable::load(ss);
+    ASSERT_TRUE(loaded.ok());
+
+    SimpleDereferenceTable& copy = **loaded;
+
+    EXPECT_EQ(copy.size(), sdt.size());
+    EXPECT_EQ(copy.n_slots(), sdt.n_slots());
+    for (usize i = 1; i < keys.size(); i += 2) {
+        const SlotIndex slot = copy.Dereference(keys[i], ptrs[i]);
+        EXPECT_EQ(slot, sdt.Dereference(keys[i], ptrs[i]));
+        EXPECT_TRUE(copy.is_allocated(slot));
+        EXPECT_EQ(copy.Get(slot).int_value(), i);
+    }
+
+    // Both tables must make the same allocation decisions from here on.
+    //
+    for (usize i = 0; i < keys.size(); i += 2) {
+        StatusOr<TinyPointer> p0 = sdt.Allocate(keys[i]);
+        StatusOr<TinyPointer> p1 = copy.Allocate(keys[i]);
+        ASSERT_TRUE(p0.ok());
+        ASSERT_TRUE(p1.ok());
+        EXPECT_EQ(p0->int_value(), p1->int_value());
+    }
+}
+
+//==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+//
+TEST(TinyPointersTest, SimpleDereferenceTable_CorruptSnapshot)
+{
+    SimpleDereferenceTable sdt{SlotCount{100000}, BitsPerSlot{64}};
+    for (usize i = 0; i < 1000; ++i) {
+        ASSERT_TRUE(sdt.Allocate(std::to_string(i)).ok());
+    }
+
+    std::stringstream ss;
+    ASSERT_TRUE(sdt.save(ss).ok());
+    const std::string snapshot = ss.str();
+
+    // Header fields (after the 8-byte magic, layout/version, and hash family):
+    // n, q, p_bits, seed, delta, size.
+    //
+    const usize kN = 24, kQ = 32, kSize = 64;
+
+    const auto load_with = [&](usize offset, u64 value) {
+        std::string corrupt = snapshot;
+        std::memcpy(corrupt.data() + offset, &value, sizeof(value));
+        std::stringstream in{corrupt};
+        return SimpleDereferenceTable::load(in).status();
+    };
+
+    EXPECT_TRUE(load_with(kSize, sdt.size()).ok());
+
+    EXPECT_EQ(load_with(kN, 0), batt::StatusCode::kDataLoss);
+    EXPECT_EQ(load_with(kN, 1), batt::StatusCode::kDataLoss);
+    EXPECT_EQ(load_with(kN, u64{1} << 50), batt::StatusCode::kDataLoss);
+    EXPECT_EQ(load_with(kQ, 0), batt::StatusCode::kDataLoss);
+    EXPECT_EQ(load_with(kQ, 16), batt::StatusCode::kDataLoss);
+    EXPECT_EQ(load_with(kQ, u64{1} << 40), batt::StatusCode::kDataLoss);
+    EXPECT_EQ(load_with(kSize, sdt.n_slots() + 1),
+              batt::StatusCode::kDataLoss);
+    EXPECT_EQ(load_with(kSize, sdt.size() - 1), batt::StatusCode::kDataLoss);
+}
+
+//==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+//
+TEST(TinyPointersTest, SimpleDereferenceTable_SaveAfterReset)
+{
+    // Clear and FreeBucket reset buckets lazily, leaving stale occupancy bits
+    // above the high-water mark; snapshots taken afterwards must still load.
+    //
+    SimpleDereferenceTable sdt{SlotCount{100000}, BitsPerSlot{64}};
+
+    const auto allocate_some = [&](const char* prefix) {
+        for (usize i = 0; i < 1000; ++i) {
+            ASSERT_TRUE(sdt.Allocate(prefix + std::to_string(i)).ok());
+        }
+    };
+
+    const auto expect_round_trip = [&] {
+        std::stringstream ss;
+        ASSERT_TRUE(sdt.save(ss).ok());
+
+        StatusOr<std::unique_ptr<SimpleDereferenceTable>> loaded =
+            SimpleDereferenceTable::load(ss);
+        ASSERT_TRUE(loaded.ok()) << loaded.status();
+        EXPECT_EQ((*loaded)->size(), sdt.size());
+        for (usize bucket_i = 0; bucket_i < sdt.bucket_count(); ++bucket_i) {
+            EXPECT_EQ((*loaded)->bucket_live_count(bucket_i),
+                      sdt.bucket_live_count(bucket_i));
+        }
+    };
+
+    allocate_some("a");
+    sdt.Clear();
+    expect_round_trip();
+
+    allocate_some("b");
+    sdt.Clear();
+    allocate_some("c");
+    expect_round_trip();
+
+    allocate_some("d");
+    sdt.FreeBucket(0);
+    expect_round_trip();
+}
+
+//==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+//
+TEST(TinyPointersTest, SimpleDereferenceTable_CheckPolicy)
+{
+    // The check policy must not change behavior: a table without checks,
+    // loaded from a snapshot of a table with them, makes the same decisions.
+    //
+    BasicSimpleDereferenceTable<FullChecks> checked{SlotCount{100000},
+                                                    BitsPerSlot{64}};
+
+    std::stringstream ss;
+    ASSERT_TRUE(checked.save(ss).ok());
+
+    StatusOr<std::unique_ptr<BasicSimpleDereferenceTable<NoChecks>>> loaded =
+        BasicSimpleDereferenceTable<NoChecks>::load(ss);
+    ASSERT_TRUE(loaded.ok());
+
+    BasicSimpleDereferenceTable<NoChecks>& unchecked = **loaded;
+
+    std::default_random_engine rng{std::random_device{}()};
+    std::vector<std::string> keys;
+    std::vector<TinyPointer> ptrs;
+    for (usize i = 0; i < 20000; ++i) {
+        keys.emplace_back(random_key(rng));
+
+        StatusOr<TinyPointer> p0 = checked.Allocate(keys.back());
+        StatusOr<TinyPointer> p1 = unchecked.Allocate(keys.back());
+        ASSERT_TRUE(p0.ok());
+        ASSERT_TRUE(p1.ok());
+        ASSERT_EQ(p0->int_value(), p1->int_value());
+
+        const SlotIndex slot = unchecked.Dereference(keys.back(), *p1);
+        EXPECT_EQ(slot, checked.Dereference(keys.back(), *p0));
+
+        unchecked.Set(slot, BitVec{64, i});
+        EXPECT_EQ(unchecked.Get(slot).int_value(), i);
+
+        ptrs.emplace_back(std::move(*p1));
+    }
+    for (usize i = 0; i < keys.size(); i += 2) {
+        checked.Free(keys[i], ptrs[i]);
+        unchecked.Free(keys[i], ptrs[i]);
+    }
+    EXPECT_EQ(checked.size(), unchecked.size());
+}
+
+//==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+//
+TEST(TinyPointersTest, HashFn_MatchesXXH3)
+{
+    std::default_random_engine rng{std::random_device{}()};
+
+    // Cover the short, mid-size, and long (derived secret) XXH3 code paths.
+    //
+    std::vector<std::string> keys;
+    for (usize len = 0; len < 600; ++len) {
+        std::string key(len, '\0');
+        for (char& ch : key) {
+            ch = (char)rng();
+        }
+        keys.emplace_back(std::move(key));
+    }
+
+    for (u64 seed : {u64{0}, u64{1}, u64{rng()}}) {
+        const HashFn hash_fn{seed};
+
+        for (usize i = 0; i < keys.size(); ++i) {
+            const u64 expected =
+                XXH3_64bits_withSeed(keys[i].data(), keys[i].size(), seed);
+
+            EXPECT_EQ(hash_fn(keys[i]), expected) << BATT_INSPECT(i);
+        }
+
+        // The batch path, over every length class at once and over sub-ranges
+        // (including ones too short for a full group of lanes).
+        //
+        std::vector<u64> hashes(keys.size());
+        hash_fn.hash_batch(keys, 0, keys.size(), hashes.data());
+        for (usize i = 0; i < keys.size(); ++i) {
+            EXPECT_EQ(hashes[i], XXH3_64bits_withSeed(keys[i].data(),
+                                                      keys[i].size(), seed))
+                << BATT_INSPECT(i);
+        }
+        for (usize begin : {0, 3, 17, 130}) {
+            for (usize count : {0, 1, 5, 9, 100}) {
+                std::vector<u64> part(count);
+                hash_fn.hash_batch(keys, begin, begin + count, part.data());
+                for (usize i = 0; i < count; ++i) {
+                    EXPECT_EQ(part[i], hashes[begin + i]);
+                }
+            }
+        }
+    }
+}
+
+//==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+//
+TEST(TinyPointersTest, HashFn_BatchBenchmark)
+{
+    using Clock = std::chrono::steady_clock;
+
+    std::default_random_engine rng{std::random_device{}()};
+
+    const usize n = 1 << 21;
+    std::vector<std::string> keys;
+    for (usize i = 0; i < n; ++i) {
+        keys.emplace_back(random_key(rng));
+    }
+
+    const u64 seed = rng();
+    const HashFn hash_fn{seed};
+
+    const auto ns_per_key = [n](auto d) {
+        return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(d)
+                   .count() /
+               (double)n;
+    };
+
+    // Hashing alone: the library one key at a time, the inlined path one key
+    // at a time, and the batch path.
+    //
+    std::vector<u64> expected(n), scalar(n), batch(n);
+
+    const auto t0 = Clock::now();
+    for (usize i = 0; i < n; ++i) {
+        expected[i] = XXH3_64bits_withSeed(keys[i].data(), keys[i].size(), seed);
+    }
+    const auto t1 = Clock::now();
+    for (usize i = 0; i < n; ++i) {
+        scalar[i] = hash_fn(keys[i]);
+    }
+    const auto t2 = Clock::now();
+    hash_fn.hash_batch(keys, 0, n, batch.data());
+    const auto t3 = Clock::now();
+
+    EXPECT_EQ(scalar, expected);
+    EXPECT_EQ(batch, expected);
+
+    std::cerr << "hash:" << BATT_INSPECT(ns_per_key(t1 - t0))
+              << BATT_INSPECT(ns_per_key(t2 - t1))
+              << BATT_INSPECT(ns_per_key(t3 - t2)) << std::endl;
+
+    // Hash + bucket + slot: Dereference one key at a time vs. BulkDereference.
+    //
+    SimpleDereferenceTable sdt{SlotCount{2 * n}, BitsPerSlot{64}, hash_fn};
+    StatusOr<std::vector<TinyPointer>> ptrs = sdt.BulkAllocate(keys);
+    ASSERT_TRUE(ptrs.ok());
+
+    const auto t4 = Clock::now();
+    std::vector<SlotIndex> slots;
+    slots.reserve(n);
+    for (usize i = 0; i < n; ++i) {
+        slots.push_back(sdt.Dereference(keys[i], (*ptrs)[i]));
+    }
+    const auto t5 = Clock::now();
+    const std::vector<SlotIndex> bulk_slots = sdt.BulkDereference(keys, *ptrs);
+    const auto t6 = Clock::now();
+
+    EXPECT_EQ(bulk_slots, slots);
+
+    std::cerr << "dereference:" << BATT_INSPECT(ns_per_key(t5 - t4))
+              << BATT_INSPECT(ns_per_key(t6 - t5)) << std::endl;
+}
+
+//==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+//
+TEST(TinyPointersTest, SimpleDereferenceTable_BulkAllocate)
+{
+    SimpleDereferenceTable sdt{SlotCount{100000}, BitsPerSlot{64}};
+
+    std::default_random_engine rng{std::random_device{}()};
+
+    // Start from a partly used table, so that bulk allocation has to follow
+    // real free lists as well as the implicit ones.
+    //
+    std::vector<std::string> old_keys;
+    std::vector<TinyPointer> old_ptrs;
+    for (usize i = 0; i < 20000; ++i) {
+        old_keys.emplace_back(random_key(rng));
+        StatusOr<TinyPointer> p = sdt.Allocate(old_keys.back());
+        ASSERT_TRUE(p.ok());
+        old_ptrs.emplace_back(std::move(*p));
+    }
+    for (usize i = 0; i < old_keys.size(); i += 3) {
+        sdt.Free(old_keys[i], old_ptrs[i]);
+    }
+
+    // A copy with the same hash seed, to allocate the same keys one at a time.
+    //
+    std::stringstream ss;
+    ASSERT_TRUE(sdt.save(ss).ok());
+    StatusOr<std::unique_ptr<SimpleDereferenceTable>> loaded =
+        SimpleDereferenceTable::load(ss);
+    ASSERT_TRUE(loaded.ok());
+    SimpleDereferenceTable& serial = **loaded;
+
+    std::vector<std::string> keys;
+    for (usize i = 0; i < 50000; ++i) {
+        keys.emplace_back(random_key(rng));
+    }
+
+    const usize size_before = sdt.size();
+
+    StatusOr<std::vector<TinyPointer>> ptrs = sdt.BulkAllocate(keys, 4);
+    ASSERT_TRUE(ptrs.ok());
+    ASSERT_EQ(ptrs->size(), keys.size());
+    EXPECT_EQ(sdt.size(), size_before + keys.size());
+
+    std::unordered_set<usize> slots;
+    for (usize i = 0; i < keys.size(); ++i) {
+        StatusOr<TinyPointer> expected = serial.Allocate(keys[i]);
+        ASSERT_TRUE(expected.ok());
+        EXPECT_EQ((*ptrs)[i].size(), sdt.tiny_pointer_size());
+        EXPECT_EQ((*ptrs)[i].int_value(), expected->int_value())
+            << BATT_INSPECT(i);
+
+        const SlotIndex slot = sdt.Dereference(keys[i], (*ptrs)[i]);
+        EXPECT_TRUE(sdt.is_allocated(slot));
+        EXPECT_TRUE(slots.insert(slot).second);
+    }
+
+    // The free lists must be left in the same state too.
+    //
+    for (usize i = 0; i < old_keys.size(); i += 3) {
+        StatusOr<TinyPointer> p0 = sdt.Allocate(old_keys[i]);
+        StatusOr<TinyPointer> p1 = serial.Allocate(old_keys[i]);
+        ASSERT_TRUE(p0.ok());
+        ASSERT_TRUE(p1.ok());
+        EXPECT_EQ(p0->int_value(), p1->int_value());
+    }
+    EXPECT_EQ(sdt.size(), serial.size());
+
+    // A batch that overflows a bucket fails without changing the table.
+    //
+    std::vector<std::string> too_many;
+    for (usize i = 0; i < sdt.n_slots(); ++i) {
+        too_many.emplace_back(std::to_string(i));
+    }
+    const usize size_after = sdt.size();
+
+    EXPECT_EQ(sdt.BulkAllocate(too_many).status(),
+              batt::StatusCode::kResourceExhausted);
+    EXPECT_EQ(sdt.size(), size_after);
+    EXPECT_TRUE(sdt.Allocate("one more").ok());
+}
+
+//==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+//
+TEST(TinyPointersTest, SimpleDereferenceTable_BulkAllocateManyBuckets)
+{
+    // Enough buckets that each thread's range has buckets in its interior as
+    // well as at the ends (whose metadata shares words with other ranges).
+    //
+    const SlotCount n{1 << 22};
+    SimpleDereferenceTable sdt{
+        n, BitsPerSlot{SimpleDereferenceTable::min_bits_per_slot(n)}};
+    ASSERT_GE(sdt.bucket_count(), 16u);
+
+    std::stringstream ss;
+    ASSERT_TRUE(sdt.save(ss).ok());
+    StatusOr<std::unique_ptr<SimpleDereferenceTable>> loaded =
+        SimpleDereferenceTable::load(ss);
+    ASSERT_TRUE(loaded.ok());
+    SimpleDereferenceTable& serial = **loaded;
+
+    std::default_random_engine rng{std::random_device{}()};
+
+    std::vector<std::string> keys;
+    for (usize i = 0; i < 200000; ++i) {
+        keys.emplace_back(random_key(rng));
+    }
+
+    StatusOr<std::vector<TinyPointer>> ptrs = sdt.BulkAllocate(keys, 4);
+    ASSERT_TRUE(ptrs.ok());
+
+    for (usize i = 0; i < keys.size(); ++i) {
+        StatusOr<TinyPointer> expected = serial.Allocate(keys[i]);
+        ASSERT_TRUE(expected.ok());
+        ASSERT_EQ((*ptrs)[i].int_value(), expected->int_value())
+            << BATT_INSPECT(i);
+    }
+
+    for (usize bucket_i = 0; bucket_i < sdt.bucket_count(); ++bucket_i) {
+        EXPECT_EQ(sdt.bucket_live_count(bucket_i),
+                  serial.bucket_live_count(bucket_i))
+            << BATT_INSPECT(bucket_i);
+    }
+    for (usize slot = 0; slot < sdt.n_slots(); ++slot) {
+        ASSERT_EQ(sdt.is_allocated(SlotIndex{slot}),
+                  serial.is_allocated(SlotIndex{slot}))
+            << BATT_INSPECT(slot);
+    }
+
+    // Every bucket's free list continues where the serial one does.
+    //
+    for (usize i = 0; i < 1000; ++i) {
+        const std::string key = random_key(rng);
+        StatusOr<TinyPointer> p0 = sdt.Allocate(key);
+        StatusOr<TinyPointer> p1 = serial.Allocate(key);
+        ASSERT_TRUE(p0.ok());
+        ASSERT_TRUE(p1.ok());
+        EXPECT_EQ(p0->int_value(), p1->int_value());
+    }
+}
+
+//==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+//
+TEST(TinyPointersTest, SimpleDereferenceTable_Footprint)
+{
+    SimpleDereferenceTable sdt{SlotCount{100000}, BitsPerSlot{64}};
+
+    const MemoryFootprint empty = sdt.footprint();
+
+    EXPECT_EQ(empty.storage_bytes, sdt.n_slots() * 8);
+    EXPECT_GT(empty.metadata_bytes, sdt.n_slots() / 8);
+    EXPECT_LT(empty.metadata_bytes, empty.storage_bytes / 8);
+    EXPECT_EQ(empty.live_entries, 0u);
+    EXPECT_EQ(empty.tiny_pointer_bits, sdt.tiny_pointer_size());
+    EXPECT_EQ(empty.net_bytes_saved(), -(i64)empty.metadata_bytes);
+
+    std::default_random_engine rng{std::random_device{}()};
+    while (sdt.size() < sdt.capacity() * 9 / 10) {
+        ASSERT_TRUE(sdt.Allocate(random_key(rng)).ok());
+    }
+
+    const MemoryFootprint full = sdt.footprint();
+
+    std::cerr << BATT_INSPECT(full) << std::endl;
+
+    EXPECT_EQ(full.total_bytes(), empty.total_bytes());
+    EXPECT_EQ(full.live_entries, sdt.size());
+    EXPECT_EQ(full.tiny_pointer_total_bits(),
+              sdt.size() * sdt.tiny_pointer_size());
+    EXPECT_EQ(full.full_pointer_total_bits(), sdt.size() * 64);
+    EXPECT_LT(full.bytes_per_live_entry(), 10.0);
+
+    // Near capacity, the pointer bits saved outweigh the metadata.
+    //
+    EXPECT_GT(full.net_bytes_saved(), 0);
+}
+
+//==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+//
+TEST(TinyPointersTest, SimpleDereferenceTable_HashFamilies)
+{
+    const HashFn::CustomFn fnv1a = [](std::string_view key, u64 seed) {
+        u64 h = 0xcbf29ce484222325ull ^ seed;
+        for (char ch : key) {
+            h = (h ^ (u8)ch) * 0x100000001b3ull;
+        }
+        return tiny_pointers::mix_u64(h);
+    };
+
+    std::default_random_engine rng{std::random_device{}()};
+    std::vector<std::string> keys;
+    for (usize i = 0; i < 90000; ++i) {
+        keys.emplace_back(random_key(rng));
+    }
+
+    for (const HashFn& hash_fn :
+         {HashFn{HashFamily::kXXH3, 42}, HashFn{HashFamily::kMultiplyMix, 42},
+          HashFn{fnv1a, 42}}) {
+        // Tables built with the same HashFn make the same decisions.
+        //
+        SimpleDereferenceTable sdt0{SlotCount{100000}, BitsPerSlot{64}, hash_fn};
+        SimpleDereferenceTable sdt1{SlotCount{100000}, BitsPerSlot{64},
+                                    HashFn{hash_fn}};
+
+        EXPECT_EQ(sdt0.hash_fn().family(), hash_fn.family());
+        EXPECT_EQ(sdt0.hash_fn().seed(), 42u);
+
+        for (const std::string& key : keys) {
+            StatusOr<TinyPointer> p0 = sdt0.Allocate(key);
+            StatusOr<TinyPointer> p1 = sdt1.Allocate(key);
+            ASSERT_TRUE(p0.ok());
+            ASSERT_TRUE(p1.ok());
+            ASSERT_EQ(p0->int_value(), p1->int_value());
+        }
+
+        // Snapshots record the family; custom functions must be supplied
+        // again.
+        //
+        std::stringstream ss;
+        ASSERT_TRUE(sdt0.save(ss).ok());
+
+        StatusOr<std::unique_ptr<SimpleDereferenceTable>> loaded =
+            (hash_fn.family() == HashFamily::kCustom)
+                ? SimpleDereferenceTable::load(ss, fnv1a)
+                : SimpleDereferenceTable::load(ss);
+        ASSERT_TRUE(loaded.ok());
+        EXPECT_EQ((*loaded)->hash_fn().family(), hash_fn.family());
+        for (usize i = 0; i < 1000; ++i) {
+            EXPECT_EQ((*loaded)->find_bucket(keys[i]),
+                      sdt0.find_bucket(keys[i]));
+        }
+
+        if (hash_fn.family() == HashFamily::kCustom) {
+            std::stringstream ss2;
+            ASSERT_TRUE(sdt0.save(ss2).ok());
+            EXPECT_EQ(SimpleDereferenceTable::load(ss2).status(),
+                      batt::StatusCode::kInvalidArgument);
+        }
+
+        // Hash speed for a few key shapes, to pick a family.
+        //
+        for (usize len : {8, 32, 256}) {
+            const std::string key(len, 'k');
+            const auto t0 = std::chrono::steady_clock::now();
+            u64 checksum = 0;
+            for (usize i = 0; i < 100000; ++i) {
+                checksum += hash_fn(key);
+            }
+            const auto t1 = std::chrono::steady_clock::now();
+
+            const double ns_per_hash =
+                (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    t1 - t0)
+                    .count() /
+                100000.0;
+
+            std::cerr << BATT_INSPECT((u32)hash_fn.family())
+                      << BATT_INSPECT(len) << BATT_INSPECT(ns_per_hash)
+                      << BATT_INSPECT(checksum) << std::endl;
+        }
+    }
+
+    // Different seeds give different bucket assignments.
+    //
+    SimpleDereferenceTable a{SlotCount{100000}, BitsPerSlot{64}, HashFn{1}};
+    SimpleDereferenceTable b{SlotCount{100000}, BitsPerSlot{64}, HashFn{2}};
+    usize same = 0;
+    for (usize i = 0; i < 1000; ++i) {
+        same += a.find_bucket(keys[i]) == b.find_bucket(keys[i]);
+    }
+    EXPECT_LT(same, 800u);
+}
+
 }  // namespace
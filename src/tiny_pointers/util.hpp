@@ -2,6 +2,9 @@
 
 #include "imports.hpp"
 
+#include <cstring>
+#include <string_view>
+
 namespace tiny_pointers {
 
 /** \brief Returns an integer in the range [0, out_range) via linear scaling of `in_val`:
@@ -18,4 +21,120 @@ inline u64 scale_u64(u64 in_val, u64 out_range)
     return ((in_val >> pre_shift) * out_range) >> post_shift;
 }
 
+/** \brief scale_u64 for a fixed `out_range`, with the shift amounts computed
+ * once up front; use this on hot paths that map hashes to buckets.
+ */
+class BucketReducer
+{
+   public:
+    explicit BucketReducer(u64 out_range) noexcept
+        : out_range_{out_range}
+        , pre_shift_{log2_ceil(out_range) + 1}
+        , post_shift_{64 - this->pre_shift_}
+    {
+    }
+
+    /** \brief Returns scale_u64(`in_val`, out_range()).
+     */
+    u64 operator()(u64 in_val) const noexcept
+    {
+        return ((in_val >> this->pre_shift_) * this->out_range_) >>
+               this->post_shift_;
+    }
+
+    u64 out_range() const noexcept
+    {
+        return this->out_range_;
+    }
+
+   private:
+    u64 out_range_;
+    i32 pre_shift_;
+    i32 post_shift_;
+};
+
+/** \brief Scrambles the bits of `in_val` (the SplitMix64 finalizer); used to
+ * derive many independent-looking hash values from a single key hash.
+ */
+inline u64 mix_u64(u64 in_val)
+{
+    in_val ^= in_val >> 30;
+    in_val *= 0xbf58476d1ce4e5b9ull;
+    in_val ^= in_val >> 27;
+    in_val *= 0x94d049bb133111ebull;
+    in_val ^= in_val >> 31;
+    return in_val;
+}
+
+namespace detail {
+
+/** \brief The 128-bit product of `a` and `b`, folded to 64 bits.
+ */
+inline u64 mum_u64(u64 a, u64 b) noexcept
+{
+    const __uint128_t r = (__uint128_t)a * b;
+    return (u64)r ^ (u64)(r >> 64);
+}
+
+inline u64 read_u32_le(const char* p) noexcept
+{
+    u32 v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline u64 read_u64_le(const char* p) noexcept
+{
+    u64 v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+}  //namespace detail
+
+/** \brief A wyhash-style string hash: 16 bytes at a time are folded into the
+ * state with one 64x64->128 bit multiply each, and keys of up to 16 bytes take
+ * no loop at all. Not a cryptographic hash.
+ */
+inline u64 multiply_mix_hash(std::string_view s, u64 seed) noexcept
+{
+    constexpr u64 kP0 = 0xa0761d6478bd642full;
+    constexpr u64 kP1 = 0xe7037ed1a0b428dbull;
+    constexpr u64 kP2 = 0x8ebc6af09c88c6e3ull;
+
+    const char* p = s.data();
+    const usize len = s.size();
+
+    seed ^= detail::mum_u64(seed ^ kP0, kP1);
+
+    u64 a = 0;
+    u64 b = 0;
+    if (len <= 16) {
+        if (len >= 4) {
+            // Two (possibly overlapping) 4-byte reads from each end.
+            //
+            const usize mid = (len >> 3) << 2;
+            a = (detail::read_u32_le(p) << 32) | detail::read_u32_le(p + mid);
+            b = (detail::read_u32_le(p + len - 4) << 32) |
+                detail::read_u32_le(p + len - 4 - mid);
+        } else if (len > 0) {
+            a = ((u64)(u8)p[0] << 16) | ((u64)(u8)p[len >> 1] << 8) |
+                (u64)(u8)p[len - 1];
+        }
+    } else {
+        usize i = len;
+        for (; i > 16; i -= 16, p += 16) {
+            seed = detail::mum_u64(detail::read_u64_le(p) ^ kP1,
+                                   detail::read_u64_le(p + 8) ^ seed);
+        }
+        // The last 16 bytes (overlapping the previous block if need be).
+        //
+        a = detail::read_u64_le(p + i - 16);
+        b = detail::read_u64_le(p + i - 8);
+    }
+
+    return detail::mum_u64(detail::mum_u64(a ^ kP1, b ^ seed) ^ kP2,
+                           len ^ kP1 ^ seed);
+}
+
 }  //namespace tiny_pointers
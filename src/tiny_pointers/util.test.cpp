@@ -5,9 +5,16 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <string>
+#include <unordered_set>
+#include <vector>
+
 namespace {
 
 using namespace batt::int_types;
+using tiny_pointers::BucketReducer;
+using tiny_pointers::mix_u64;
+using tiny_pointers::multiply_mix_hash;
 using tiny_pointers::scale_u64;
 
 TEST(UtilTest, ScaleU64)
@@ -20,4 +27,61 @@ TEST(UtilTest, ScaleU64)
     }
 }
 
+TEST(UtilTest, BucketReducer)
+{
+    for (usize out_range : {1, 7, 8, 100, 999, 1024, 123456}) {
+        const BucketReducer reduce{out_range};
+
+        EXPECT_EQ(reduce.out_range(), out_range);
+        EXPECT_EQ(reduce(0), 0);
+        EXPECT_EQ(reduce(~u64{0}), out_range - 1);
+
+        for (u64 i = 0; i < 1000; ++i) {
+            const u64 in_val = mix_u64(i);
+            EXPECT_EQ(reduce(in_val), scale_u64(in_val, out_range));
+        }
+    }
+}
+
+TEST(UtilTest, MultiplyMixHash)
+{
+    // Cover every length class (0, 1-3, 4-16, and multi-block).
+    //
+    std::vector<std::string> keys;
+    for (usize len = 0; len < 100; ++len) {
+        std::string key(len, 'a');
+        for (usize i = 0; i < len; ++i) {
+            key[i] = (char)('a' + (i * 7 + len) % 26);
+        }
+        keys.emplace_back(std::move(key));
+    }
+
+    std::unordered_set<u64> seen;
+    for (const std::string& key : keys) {
+        const u64 h = multiply_mix_hash(key, 1);
+
+        EXPECT_EQ(multiply_mix_hash(key, 1), h);
+        EXPECT_NE(multiply_mix_hash(key, 2), h);
+        EXPECT_TRUE(seen.insert(h).second) << BATT_INSPECT(key.size());
+
+        // Flipping any input bit changes the hash.
+        //
+        for (usize i = 0; i < key.size(); ++i) {
+            std::string flipped = key;
+            flipped[i] ^= 1;
+            EXPECT_NE(multiply_mix_hash(flipped, 1), h);
+        }
+    }
+
+    // The high bits (used to pick buckets) are balanced.
+    //
+    usize top_bit_count = 0;
+    for (u64 i = 0; i < 10000; ++i) {
+        const std::string key = std::to_string(i);
+        top_bit_count += multiply_mix_hash(key, 0) >> 63;
+    }
+    EXPECT_GT(top_bit_count, 4700u);
+    EXPECT_LT(top_bit_count, 5300u);
+}
+
 }  //namespace
@@ -0,0 +1,719 @@
+#pragma once
+
+#include "data.hpp"
+#include "imports.hpp"
+#include "snapshot.hpp"
+#include "tiny_pointers.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <istream>
+#include <ostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace tiny_pointers {
+
+//=#=#==#==#===============+=+=+=+=++=++++++++++++++-++-+--+-+----+---------------
+
+/** \brief How a workload picks which key each operation targets.
+ */
+enum struct KeyDistribution {
+    kUniform,
+    kZipfian,
+    kSequential,
+};
+
+/** \brief Picks key indices in [0, n) according to a KeyDistribution.
+ *
+ * Zipfian uses the generator from YCSB (Gray et al., "Quickly Generating
+ * Billion-Record Synthetic Databases"): index 0 is the most popular, with
+ * popularity falling off as 1/(i+1)^theta. Sequential cycles through the
+ * indices in order.
+ */
+class KeyChooser
+{
+   public:
+    static constexpr double kDefaultZipfTheta = 0.99;
+
+    KeyChooser(KeyDistribution distribution, usize n,
+               double zipf_theta = kDefaultZipfTheta) noexcept
+        : distribution_{distribution}
+        , n_{n}
+        , theta_{zipf_theta}
+    {
+        BATT_CHECK_GT(n, 0u);
+
+        if (this->distribution_ == KeyDistribution::kZipfian) {
+            BATT_CHECK_GT(this->theta_, 0.0);
+            BATT_CHECK_LT(this->theta_, 1.0);
+
+            double zeta_2 = 0;
+            for (usize i = 1; i <= this->n_; ++i) {
+                const double term = 1.0 / std::pow((double)i, this->theta_);
+                this->zeta_n_ += term;
+                if (i <= 2) {
+                    zeta_2 += term;
+                }
+            }
+            this->alpha_ = 1.0 / (1.0 - this->theta_);
+            this->eta_ =
+                (1.0 - std::pow(2.0 / (double)this->n_, 1.0 - this->theta_)) /
+                (1.0 - zeta_2 / this->zeta_n_);
+        }
+    }
+
+    usize key_count() const noexcept
+    {
+        return this->n_;
+    }
+
+    template <typename Rng>
+    usize operator()(Rng& rng) noexcept
+    {
+        switch (this->distribution_) {
+            case KeyDistribution::kUniform:
+                return std::uniform_int_distribution<usize>{0, this->n_ - 1}(
+                    rng);
+
+            case KeyDistribution::kZipfian: {
+                const double u =
+                    std::uniform_real_distribution<double>{0.0, 1.0}(rng);
+                const double uz = u * this->zeta_n_;
+                if (uz < 1.0) {
+                    return 0;
+                }
+                if (uz < 1.0 + std::pow(0.5, this->theta_)) {
+                    return std::min<usize>(1, this->n_ - 1);
+                }
+                return std::min<usize>(
+                    this->n_ - 1,
+                    (usize)((double)this->n_ *
+                            std::pow(this->eta_ * u - this->eta_ + 1.0,
+                                     this->alpha_)));
+            }
+
+            case KeyDistribution::kSequential:
+                break;
+        }
+
+        const usize i = this->next_;
+        this->next_ = (this->next_ + 1) % this->n_;
+        return i;
+    }
+
+   private:
+    KeyDistribution distribution_;
+    usize n_;
+    double theta_;
+
+    // Zipfian state.
+    //
+    double zeta_n_ = 0;
+    double alpha_ = 0;
+    double eta_ = 0;
+
+    // Sequential state.
+    //
+    usize next_ = 0;
+};
+
+//=#=#==#==#===============+=+=+=+=++=++++++++++++++-++-+--+-+----+---------------
+
+/** \brief The text keys are built from.
+ */
+enum struct KeySource {
+    // data/words - a dictionary; every word is distinct.
+    //
+    kWords,
+
+    // The text files of the Calgary corpus (data/calgary); natural word
+    // frequencies, so keys built from it repeat more often.
+    //
+    kCalgary,
+};
+
+namespace detail {
+
+/** \brief The words of KeySource::kWords, loaded on first use.
+ */
+inline const KeyArena& dictionary_words()
+{
+    static const KeyArena words = [] {
+        KeyArena words;
+        load_words_mapped_rel(std::filesystem::path{"data"} / "words", words);
+        return words;
+    }();
+
+    return words;
+}
+
+/** \brief The words of KeySource::kCalgary, loaded on first use.
+ */
+inline const KeyArena& calgary_words()
+{
+    static const KeyArena words = [] {
+        KeyArena words;
+        for (const char* name : {"bib", "book1", "book2", "news", "paper1",
+                                 "paper2", "paper3", "paper4", "paper5",
+                                 "paper6"}) {
+            load_words_mapped_rel(
+                std::filesystem::path{"data"} / "calgary" / name, words);
+        }
+        return words;
+    }();
+
+    return words;
+}
+
+}  //namespace detail
+
+/** \brief Returns the words of `source`, loaded once and then cached; only the
+ * requested source is ever loaded.
+ */
+inline const KeyArena& source_words(KeySource source)
+{
+    switch (source) {
+        case KeySource::kWords:
+            return detail::dictionary_words();
+        case KeySource::kCalgary:
+            break;
+    }
+    return detail::calgary_words();
+}
+
+/** \brief Returns `count` keys, each made of `words_per_key` words picked
+ * uniformly at random from `words` (a KeyArena or a std::vector<std::string>)
+ * and separated by spaces (the same format as random_key).
+ */
+template <typename WordList>
+inline KeyArena make_keys(const WordList& words, usize count,
+                          std::default_random_engine& rng,
+                          usize words_per_key = 2)
+{
+    BATT_CHECK(!words.empty());
+
+    std::uniform_int_distribution<usize> pick_word{0, words.size() - 1};
+    std::vector<std::string_view> parts(words_per_key);
+
+    KeyArena keys;
+    keys.reserve(count, count * words_per_key * 10);
+
+    for (usize i = 0; i < count; ++i) {
+        for (std::string_view& part : parts) {
+            part = words[pick_word(rng)];
+        }
+        keys.push_back_joined(parts, ' ');
+    }
+
+    return keys;
+}
+
+//=#=#==#==#===============+=+=+=+=++=++++++++++++++-++-+--+-+----+---------------
+
+enum struct OpType : u8 {
+    kAllocate = 0,
+    kDereference = 1,
+    kFree = 2,
+
+    // Frees every live key; its `key` is always 0.
+    //
+    kClear = 3,
+};
+
+/** \brief One operation in a Trace, on the `key`-th key of the trace.
+ */
+struct Op {
+    OpType type;
+    usize key;
+};
+
+inline bool operator==(const Op& l, const Op& r)
+{
+    return l.type == r.type && l.key == r.key;
+}
+
+/** \brief The relative frequencies of each kind of operation.
+ */
+struct OpMix {
+    double allocate;
+    double dereference;
+    double free;
+
+    /** \brief YCSB "load" phase: insert only.
+     */
+    static OpMix load()
+    {
+        return OpMix{1.0, 0.0, 0.0};
+    }
+
+    /** \brief YCSB workload C: read only.
+     */
+    static OpMix read_only()
+    {
+        return OpMix{0.0, 1.0, 0.0};
+    }
+
+    /** \brief Like YCSB workload B: 95% reads; the remaining updates are
+     * modelled as deletes and (re-)inserts.
+     */
+    static OpMix read_mostly()
+    {
+        return OpMix{0.025, 0.95, 0.025};
+    }
+
+    /** \brief Like YCSB workload A: 50% reads, 50% deletes and (re-)inserts.
+     */
+    static OpMix update_heavy()
+    {
+        return OpMix{0.25, 0.5, 0.25};
+    }
+};
+
+/** \brief Describes a workload to generate with make_trace.
+ */
+struct WorkloadSpec {
+    // The number of distinct keys.
+    //
+    usize key_count;
+
+    // The number of keys to allocate, in order, before the mixed operations.
+    //
+    usize preload_count = 0;
+
+    // The number of mixed operations, after the preload.
+    //
+    usize op_count = 0;
+
+    KeyDistribution distribution = KeyDistribution::kUniform;
+    OpMix mix = OpMix::read_mostly();
+    KeySource source = KeySource::kWords;
+    usize words_per_key = 2;
+};
+
+/** \brief A recorded sequence of operations, together with the keys they
+ * operate on.
+ *
+ * A trace is valid if it only allocates keys that aren't live and only
+ * dereferences or frees keys that are (as if every allocation succeeds); those
+ * made by make_trace and TraceRecorder are.
+ */
+struct Trace {
+    static constexpr std::string_view kMagic{"TNYTRACE", 8};
+
+    // Version 2 added OpType::kClear; version 1 traces are still readable.
+    //
+    static constexpr u64 kVersion = 2;
+
+    /** \brief Limits on the sizes load will accept from a trace, so that a
+     * corrupt count is reported as kDataLoss instead of attempting an enormous
+     * allocation: at most 2^36 bytes of keys, 2^32 keys, and 2^32 operations.
+     * A count is also rejected if the stream is seekable and doesn't have that
+     * much data left.
+     */
+    static constexpr u64 kMaxKeyBytes = u64{1} << 36;
+    static constexpr u64 kMaxKeyCount = u64{1} << 32;
+    static constexpr u64 kMaxOpCount = u64{1} << 32;
+
+    KeyArena keys;
+    std::vector<Op> ops;
+
+    /** \brief Writes this trace to `out`.
+     */
+    Status save(std::ostream& out) const
+    {
+        static_assert(sizeof(usize) == sizeof(u64));
+
+        BATT_REQUIRE_OK(write_bytes(out, kMagic.data(), kMagic.size()));
+        BATT_REQUIRE_OK(write_u64(out, kVersion));
+
+        BATT_REQUIRE_OK(write_u64(out, this->keys.byte_size()));
+        BATT_REQUIRE_OK(write_bytes(out, this->keys.bytes().data(),
+                                    this->keys.byte_size()));
+        BATT_REQUIRE_OK(write_u64(out, this->keys.offsets().size()));
+        BATT_REQUIRE_OK(write_bytes(out, this->keys.offsets().data(),
+                                    this->keys.offsets().size() * sizeof(u64)));
+
+        std::vector<u64> packed_ops;
+        packed_ops.reserve(this->ops.size());
+        for (const Op& op : this->ops) {
+            packed_ops.emplace_back((u64{op.key} << 8) | (u64)op.type);
+        }
+        return write_words(out, packed_ops);
+    }
+
+    /** \brief Reads a trace written by save; returns kDataLoss if the stream
+     * is truncated, corrupt, or isn't a trace, and kUnimplemented if it was
+     * written by an incompatible version.
+     */
+    static StatusOr<Trace> load(std::istream& in)
+    {
+        char magic[kMagic.size()];
+        BATT_REQUIRE_OK(read_bytes(in, magic, sizeof(magic)));
+        if (std::string_view{magic, sizeof(magic)} != kMagic) {
+            return {batt::StatusCode::kDataLoss};
+        }
+        BATT_ASSIGN_OK_RESULT(const u64 version, read_u64(in));
+        if (version < 1 || version > kVersion) {
+            return {batt::StatusCode::kUnimplemented};
+        }
+
+        BATT_ASSIGN_OK_RESULT(const u64 byte_size, read_u64(in));
+        if (!count_ok(in, byte_size, 1, kMaxKeyBytes)) {
+            return {batt::StatusCode::kDataLoss};
+        }
+        std::string bytes(byte_size, '\0');
+        BATT_REQUIRE_OK(read_bytes(in, bytes.data(), byte_size));
+
+        BATT_ASSIGN_OK_RESULT(const u64 offset_count, read_u64(in));
+        if (!count_ok(in, offset_count, sizeof(u64), kMaxKeyCount + 1)) {
+            return {batt::StatusCode::kDataLoss};
+        }
+        std::vector<usize> offsets(offset_count);
+        BATT_REQUIRE_OK(
+            read_bytes(in, offsets.data(), offset_count * sizeof(u64)));
+
+        if (offsets.empty() || offsets.front() != 0 ||
+            offsets.back() != bytes.size() ||
+            !std::is_sorted(offsets.begin(), offsets.end())) {
+            return {batt::StatusCode::kDataLoss};
+        }
+
+        Trace trace;
+        trace.keys.assign(std::move(bytes), std::move(offsets));
+
+        BATT_ASSIGN_OK_RESULT(const u64 op_count, read_u64(in));
+        if (!count_ok(in, op_count, sizeof(u64), kMaxOpCount)) {
+            return {batt::StatusCode::kDataLoss};
+        }
+        std::vector<u64> packed_ops(op_count);
+        BATT_REQUIRE_OK(
+            read_bytes(in, packed_ops.data(), op_count * sizeof(u64)));
+
+        trace.ops.reserve(op_count);
+        for (const u64 packed : packed_ops) {
+            const u64 type = packed & 0xff;
+            const usize key = packed >> 8;
+            const bool valid =
+                (type == (u64)OpType::kClear)
+                    ? (version >= 2 && key == 0)
+                    : (type <= (u64)OpType::kFree && key < trace.keys.size());
+            if (!valid) {
+                return {batt::StatusCode::kDataLoss};
+            }
+            trace.ops.emplace_back(Op{(OpType)type, key});
+        }
+
+        return trace;
+    }
+
+   private:
+    /** \brief Returns true iff `count` items of `item_size` bytes are within
+     * `max_count` and, if `in` is seekable, within the bytes left in it.
+     */
+    static bool count_ok(std::istream& in, u64 count, u64 item_size,
+                         u64 max_count)
+    {
+        if (count > max_count) {
+            return false;
+        }
+
+        const std::istream::pos_type pos = in.tellg();
+        if (pos == std::istream::pos_type(-1)) {
+            return true;
+        }
+        const std::istream::pos_type end = in.seekg(0, std::ios::end).tellg();
+        in.clear();
+        in.seekg(pos);
+        if (end == std::istream::pos_type(-1)) {
+            return true;
+        }
+
+        return count * item_size <= (u64)(end - pos);
+    }
+};
+
+/** \brief Generates a valid trace for `spec`.
+ *
+ * Each mixed operation picks its type from `spec.mix` and its key from
+ * `spec.distribution`; an allocate that hits a live key becomes a dereference,
+ * and a dereference or free that hits a dead key becomes an allocate. So the
+ * key access pattern follows the distribution exactly, and the operation mix
+ * approximately.
+ */
+inline Trace make_trace(const WorkloadSpec& spec,
+                        std::default_random_engine& rng)
+{
+    BATT_CHECK_LE(spec.preload_count, spec.key_count);
+
+    Trace trace;
+    trace.keys = make_keys(source_words(spec.source), spec.key_count, rng,
+                           spec.words_per_key);
+    trace.ops.reserve(spec.preload_count + spec.op_count);
+
+    std::vector<bool> live(spec.key_count, false);
+
+    for (usize key_i = 0; key_i < spec.preload_count; ++key_i) {
+        trace.ops.emplace_back(Op{OpType::kAllocate, key_i});
+        live[key_i] = true;
+    }
+
+    KeyChooser choose_key{spec.distribution, spec.key_count};
+    std::discrete_distribution<int> choose_type{
+        spec.mix.allocate, spec.mix.dereference, spec.mix.free};
+
+    for (usize op_i = 0; op_i < spec.op_count; ++op_i) {
+        OpType type = (OpType)choose_type(rng);
+        const usize key_i = choose_key(rng);
+
+        if (live[key_i] && type == OpType::kAllocate) {
+            type = OpType::kDereference;
+        } else if (!live[key_i] && type != OpType::kAllocate) {
+            type = OpType::kAllocate;
+        }
+
+        trace.ops.emplace_back(Op{type, key_i});
+        if (type == OpType::kAllocate) {
+            live[key_i] = true;
+        } else if (type == OpType::kFree) {
+            live[key_i] = false;
+        }
+    }
+
+    return trace;
+}
+
+//=#=#==#==#===============+=+=+=+=++=++++++++++++++-++-+--+-+----+---------------
+
+/** \brief The outcome of replaying a trace against a table.
+ */
+struct ReplayStats {
+    usize allocates = 0;
+    usize dereferences = 0;
+    usize frees = 0;
+    usize clears = 0;
+
+    // Allocations the table refused (e.g., because it was full).
+    //
+    usize failed_allocates = 0;
+
+    // Dereferences and frees of keys whose allocation had failed.
+    //
+    usize skipped = 0;
+
+    // The sum of the values read by all dereferences, so the reads can't be
+    // optimized away.
+    //
+    u64 checksum = 0;
+
+    std::chrono::nanoseconds elapsed{0};
+
+    usize op_count() const noexcept
+    {
+        return this->allocates + this->dereferences + this->frees +
+               this->clears;
+    }
+
+    double ns_per_op() const noexcept
+    {
+        return (double)this->elapsed.count() /
+               (double)std::max<usize>(1, this->op_count());
+    }
+};
+
+/** \brief Runs the operations of `trace` against `table`, timing them. Each
+ * dereference also reads the slot's value (see ReplayStats::checksum).
+ */
+inline ReplayStats replay(DereferenceTable& table, const Trace& trace)
+{
+    using Clock = std::chrono::steady_clock;
+
+    ReplayStats stats;
+    std::vector<TinyPointer> ptrs(trace.keys.size());
+    std::vector<bool> live(trace.keys.size(), false);
+
+    const auto start = Clock::now();
+
+    for (const Op& op : trace.ops) {
+        if (op.type == OpType::kClear) {
+            ++stats.clears;
+            table.Clear();
+            live.assign(live.size(), false);
+            continue;
+        }
+
+        const Key key = trace.keys[op.key];
+
+        if (op.type != OpType::kAllocate && !live[op.key]) {
+            ++stats.skipped;
+            continue;
+        }
+
+        switch (op.type) {
+            case OpType::kAllocate: {
+                ++stats.allocates;
+                StatusOr<TinyPointer> p = table.Allocate(key);
+                if (!p.ok()) {
+                    ++stats.failed_allocates;
+                    break;
+                }
+                ptrs[op.key] = std::move(*p);
+                live[op.key] = true;
+                break;
+            }
+
+            case OpType::kDereference:
+                ++stats.dereferences;
+                stats.checksum +=
+                    table.Get(table.Dereference(key, ptrs[op.key]))
+                        .int_value();
+                break;
+
+            case OpType::kFree:
+                ++stats.frees;
+                table.Free(key, ptrs[op.key]);
+                live[op.key] = false;
+                break;
+
+            case OpType::kClear:
+                break;
+        }
+    }
+
+    stats.elapsed = Clock::now() - start;
+
+    return stats;
+}
+
+//=#=#==#==#===============+=+=+=+=++=++++++++++++++-++-+--+-+----+---------------
+
+/** \brief A DereferenceTable that forwards to another table, recording the
+ * Allocate, Dereference, Free, and Clear calls made on it (with or without a
+ * hint) as a Trace. Failed allocations are not recorded, so the trace stays
+ * valid.
+ *
+ * Set and Get are forwarded but not recorded.
+ */
+class TraceRecorder : public DereferenceTable
+{
+   public:
+    explicit TraceRecorder(DereferenceTable& table) noexcept : table_{table}
+    {
+    }
+
+    /** \brief The operations recorded so far.
+     */
+    const Trace& trace() const noexcept
+    {
+        return this->trace_;
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    //
+    StatusOr<TinyPointer> Allocate(Key x) noexcept override
+    {
+        StatusOr<TinyPointer> p = this->table_.Allocate(x);
+        if (p.ok()) {
+            this->record(OpType::kAllocate, x);
+        }
+        return p;
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    //
+    StatusOr<TinyPointer> Allocate(Key x, LocalityHint hint) noexcept override
+    {
+        StatusOr<TinyPointer> p = this->table_.Allocate(x, hint);
+        if (p.ok()) {
+            this->record(OpType::kAllocate, x);
+        }
+        return p;
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    //
+    SlotIndex Dereference(Key x, TinyPointer p) noexcept override
+    {
+        this->record(OpType::kDereference, x);
+        return this->table_.Dereference(x, std::move(p));
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    //
+    SlotIndex Dereference(Key x, LocalityHint hint,
+                          TinyPointer p) noexcept override
+    {
+        this->record(OpType::kDereference, x);
+        return this->table_.Dereference(x, hint, std::move(p));
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    //
+    void Free(Key x, TinyPointer p) noexcept override
+    {
+        this->record(OpType::kFree, x);
+        this->table_.Free(x, std::move(p));
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    //
+    void Free(Key x, LocalityHint hint, TinyPointer p) noexcept override
+    {
+        this->record(OpType::kFree, x);
+        this->table_.Free(x, hint, std::move(p));
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    //
+    void Set(SlotIndex i, Value v) noexcept override
+    {
+        this->table_.Set(i, std::move(v));
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    //
+    Value Get(SlotIndex i) noexcept override
+    {
+        return this->table_.Get(i);
+    }
+
+    //==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+    //
+    void Clear() noexcept override
+    {
+        this->trace_.ops.emplace_back(Op{OpType::kClear, 0});
+        this->table_.Clear();
+    }
+
+    /** \brief The footprint of the underlying table; the recorded trace is not
+     * counted.
+     */
+    MemoryFootprint footprint() const noexcept override
+    {
+        return this->table_.footprint();
+    }
+
+   private:
+    void record(OpType type, Key x)
+    {
+        auto [iter, inserted] =
+            this->key_index_.emplace(std::string{x}, this->trace_.keys.size());
+        if (inserted) {
+            this->trace_.keys.push_back(x);
+        }
+        this->trace_.ops.emplace_back(Op{type, iter->second});
+    }
+
+    //+++++++++++-+-+--+----- --- -- -  -  -   -
+
+    DereferenceTable& table_;
+    Trace trace_;
+    std::unordered_map<std::string, usize> key_index_;
+};
+
+}  //namespace tiny_pointers
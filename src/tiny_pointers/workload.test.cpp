@@ -0,0 +1,277 @@
+#include <tiny_pointers/workload.hpp>
+//
+#include <tiny_pointers/workload.hpp>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+using namespace batt::int_types;
+using tiny_pointers::BitsPerSlot;
+using tiny_pointers::KeyArena;
+using tiny_pointers::KeyChooser;
+using tiny_pointers::KeyDistribution;
+using tiny_pointers::KeySource;
+using tiny_pointers::make_keys;
+using tiny_pointers::make_trace;
+using tiny_pointers::Op;
+using tiny_pointers::OpMix;
+using tiny_pointers::OpType;
+using tiny_pointers::replay;
+using tiny_pointers::ReplayStats;
+using tiny_pointers::SimpleDereferenceTable;
+using tiny_pointers::SlotCount;
+using tiny_pointers::source_words;
+using tiny_pointers::StatusOr;
+using tiny_pointers::Trace;
+using tiny_pointers::TraceRecorder;
+using tiny_pointers::WorkloadSpec;
+
+//==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+//
+TEST(WorkloadTest, KeyChooser)
+{
+    std::default_random_engine rng{std::random_device{}()};
+    const usize n = 1000;
+
+    {
+        KeyChooser choose{KeyDistribution::kSequential, n};
+        for (usize i = 0; i < 2 * n; ++i) {
+            EXPECT_EQ(choose(rng), i % n);
+        }
+    }
+
+    for (KeyDistribution distribution :
+         {KeyDistribution::kUniform, KeyDistribution::kZipfian}) {
+        KeyChooser choose{distribution, n};
+        std::vector<usize> counts(n, 0);
+        for (usize i = 0; i < 100 * n; ++i) {
+            const usize key_i = choose(rng);
+            ASSERT_LT(key_i, n);
+            ++counts[key_i];
+        }
+
+        // Zipfian with theta ~= 1: the most popular key gets about 1/H(n) of
+        // the accesses (~13% for n = 1000); uniform gets ~0.1% each.
+        //
+        if (distribution == KeyDistribution::kZipfian) {
+            EXPECT_GT(counts[0], 10 * n);
+            EXPECT_GT(counts[0], 10 * counts[n / 2]);
+        } else {
+            EXPECT_LT(counts[0], 200);
+        }
+    }
+}
+
+//==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+//
+TEST(WorkloadTest, MakeKeys)
+{
+    std::default_random_engine rng{std::random_device{}()};
+
+    for (KeySource source : {KeySource::kWords, KeySource::kCalgary}) {
+        const KeyArena keys = make_keys(source_words(source), 10000, rng, 3);
+
+        ASSERT_EQ(keys.size(), 10000u);
+        for (usize i = 0; i < keys.size(); ++i) {
+            EXPECT_EQ(std::count(keys[i].begin(), keys[i].end(), ' '), 2);
+        }
+    }
+}
+
+//==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+//
+TEST(WorkloadTest, TraceIsValid)
+{
+    std::default_random_engine rng{std::random_device{}()};
+
+    for (KeyDistribution distribution :
+         {KeyDistribution::kUniform, KeyDistribution::kZipfian,
+          KeyDistribution::kSequential}) {
+        const Trace trace = make_trace(
+            WorkloadSpec{
+                .key_count = 5000,
+                .preload_count = 2500,
+                .op_count = 50000,
+                .distribution = distribution,
+                .mix = OpMix::update_heavy(),
+            },
+            rng);
+
+        ASSERT_EQ(trace.ops.size(), 52500u);
+
+        std::vector<bool> live(trace.keys.size(), false);
+        usize counts[3] = {0, 0, 0};
+        for (const Op& op : trace.ops) {
+            ASSERT_EQ(live[op.key], op.type != OpType::kAllocate);
+            live[op.key] = (op.type != OpType::kFree);
+            ++counts[(usize)op.type];
+        }
+
+        std::cerr << BATT_INSPECT((int)distribution)
+                  << BATT_INSPECT(counts[0]) << BATT_INSPECT(counts[1])
+                  << BATT_INSPECT(counts[2]) << std::endl;
+
+        EXPECT_GT(counts[(usize)OpType::kDereference], 0u);
+        EXPECT_GT(counts[(usize)OpType::kFree], 0u);
+    }
+}
+
+//==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+//
+TEST(WorkloadTest, SaveLoadReplayRecord)
+{
+    std::default_random_engine rng{std::random_device{}()};
+
+    const Trace trace = make_trace(
+        WorkloadSpec{
+            .key_count = 20000,
+            .preload_count = 10000,
+            .op_count = 100000,
+            .distribution = KeyDistribution::kZipfian,
+        },
+        rng);
+
+    std::stringstream ss;
+    ASSERT_TRUE(trace.save(ss).ok());
+
+    StatusOr<Trace> loaded = Trace::load(ss);
+    ASSERT_TRUE(loaded.ok());
+    EXPECT_EQ(loaded->keys.bytes(), trace.keys.bytes());
+    EXPECT_EQ(loaded->keys.offsets(), trace.keys.offsets());
+    EXPECT_EQ(loaded->ops, trace.ops);
+
+    {
+        std::stringstream truncated{ss.str().substr(0, 100)};
+        EXPECT_FALSE(Trace::load(truncated).ok());
+    }
+
+    // Replay through a recorder; the recorded trace has the same operations
+    // on the same keys.
+    //
+    SimpleDereferenceTable sdt{SlotCount{100000}, BitsPerSlot{64}};
+    TraceRecorder recorder{sdt};
+
+    const ReplayStats stats = replay(recorder, *loaded);
+
+    std::cerr << BATT_INSPECT(stats.op_count())
+              << BATT_INSPECT(stats.ns_per_op()) << std::endl;
+
+    EXPECT_EQ(stats.op_count(), trace.ops.size());
+    EXPECT_EQ(stats.failed_allocates, 0u);
+    EXPECT_EQ(stats.skipped, 0u);
+
+    const Trace& recorded = recorder.trace();
+    ASSERT_EQ(recorded.ops.size(), trace.ops.size());
+    for (usize i = 0; i < trace.ops.size(); ++i) {
+        EXPECT_EQ(recorded.ops[i].type, trace.ops[i].type);
+        EXPECT_EQ(recorded.keys[recorded.ops[i].key],
+                  trace.keys[trace.ops[i].key]);
+    }
+
+    usize live = 0;
+    for (const Op& op : trace.ops) {
+        live += (op.type == OpType::kAllocate) - (op.type == OpType::kFree);
+    }
+    EXPECT_EQ(sdt.size(), live);
+}
+
+//==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+//
+TEST(WorkloadTest, LoadRejectsCorruptCounts)
+{
+    std::default_random_engine rng{std::random_device{}()};
+
+    const Trace trace = make_trace(
+        WorkloadSpec{
+            .key_count = 100,
+            .preload_count = 50,
+            .op_count = 100,
+        },
+        rng);
+
+    std::stringstream ss;
+    ASSERT_TRUE(trace.save(ss).ok());
+    const std::string saved = std::move(ss).str();
+
+    // The counts of key bytes, key offsets, and ops, in order.
+    //
+    const usize byte_size_pos = 16;
+    const usize offset_count_pos =
+        byte_size_pos + sizeof(u64) + trace.keys.byte_size();
+    const usize op_count_pos = offset_count_pos + sizeof(u64) +
+                               trace.keys.offsets().size() * sizeof(u64);
+
+    for (const usize pos : {byte_size_pos, offset_count_pos, op_count_pos}) {
+        // Over the limits, and within them but past the end of the stream.
+        //
+        for (const u64 count : {~u64{0}, u64{1} << 62, u64{1} << 30}) {
+            std::string corrupt = saved;
+            std::memcpy(corrupt.data() + pos, &count, sizeof(count));
+
+            std::stringstream in{corrupt};
+            StatusOr<Trace> loaded = Trace::load(in);
+
+            EXPECT_EQ(loaded.status(),
+                      batt::Status{batt::StatusCode::kDataLoss})
+                << BATT_INSPECT(pos) << BATT_INSPECT(count);
+        }
+    }
+
+    std::stringstream in{saved};
+    EXPECT_TRUE(Trace::load(in).ok());
+}
+
+//==#==========+==+=+=++=+++++++++++-+-+--+----- --- -- -  -  -   -
+//
+TEST(WorkloadTest, RecordClear)
+{
+    SimpleDereferenceTable sdt{SlotCount{1000}, BitsPerSlot{64}};
+    TraceRecorder recorder{sdt};
+
+    KeyArena keys;
+    for (usize i = 0; i < 100; ++i) {
+        keys.push_back(std::to_string(i));
+    }
+
+    // Allocate every key, clear, and allocate half of them again.
+    //
+    for (usize i = 0; i < keys.size(); ++i) {
+        ASSERT_TRUE(recorder.Allocate(keys[i]).ok());
+    }
+    recorder.Clear();
+    for (usize i = 0; i < keys.size() / 2; ++i) {
+        ASSERT_TRUE(recorder.Allocate(keys[i]).ok());
+    }
+
+    const Trace& recorded = recorder.trace();
+    ASSERT_EQ(recorded.ops.size(), keys.size() + 1 + keys.size() / 2);
+    EXPECT_EQ(recorded.ops[keys.size()], (Op{OpType::kClear, 0}));
+
+    std::stringstream ss;
+    ASSERT_TRUE(recorded.save(ss).ok());
+
+    StatusOr<Trace> loaded = Trace::load(ss);
+    ASSERT_TRUE(loaded.ok());
+    EXPECT_EQ(loaded->ops, recorded.ops);
+
+    // Without the Clear, the re-allocations would be of live keys.
+    //
+    SimpleDereferenceTable replayed{SlotCount{1000}, BitsPerSlot{64}};
+    const ReplayStats stats = replay(replayed, *loaded);
+
+    EXPECT_EQ(stats.clears, 1u);
+    EXPECT_EQ(stats.allocates, keys.size() + keys.size() / 2);
+    EXPECT_EQ(stats.failed_allocates, 0u);
+    EXPECT_EQ(replayed.size(), sdt.size());
+    EXPECT_EQ(replayed.size(), keys.size() / 2);
+}
+
+}  // namespace